@@ -0,0 +1,179 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+use std::io::Cursor;
+use std::time::Instant;
+
+use xfs_fuse::libxfuse::bmbt_rec::{BmbtRec, XfsExntst};
+use xfs_fuse::libxfuse::da_btree::hashname;
+use xfs_fuse::libxfuse::dir3::Dir2DataEntry;
+use xfs_fuse::libxfuse::file_extent_list::FileExtentList;
+use xfs_fuse::libxfuse::view::Dir2DataEntryIter;
+
+// Micro-benchmarks for the metadata hot paths, run with `cargo bench`.
+// Each case reports ns per operation; track the numbers release to release.
+// The read path against a real device is covered by scripts/bench_fuse.py,
+// which measures a mounted volume end to end.
+
+fn bench<F: FnMut()>(name: &str, iters: u64, mut f: F) {
+    // Warm up caches and branch predictors before timing.
+    for _i in 0..(iters / 10 + 1) {
+        f();
+    }
+
+    let start = Instant::now();
+    for _i in 0..iters {
+        f();
+    }
+    let elapsed = start.elapsed();
+
+    println!(
+        "{:<40} {:>12.1} ns/op",
+        name,
+        (elapsed.as_nanos() as f64) / (iters as f64)
+    );
+}
+
+// Build one on-disk directory data entry at the given offset and return the
+// offset just past it.
+fn put_entry(block: &mut [u8], offset: usize, inumber: u64, name: &[u8]) -> usize {
+    let length = (12 + name.len() + 7) & !7;
+
+    block[offset..offset + 8].copy_from_slice(&inumber.to_be_bytes());
+    block[offset + 8] = name.len() as u8;
+    block[offset + 9..offset + 9 + name.len()].copy_from_slice(name);
+    block[offset + 9 + name.len()] = 1;
+    block[offset + length - 2..offset + length]
+        .copy_from_slice(&(offset as u16).to_be_bytes());
+
+    offset + length
+}
+
+fn bench_hashname() {
+    bench("hashname (8 byte name)", 1_000_000, || {
+        std::hint::black_box(hashname(std::hint::black_box("file0042")));
+    });
+
+    bench("hashname (40 byte name, uncached)", 1_000_000, || {
+        // A fresh suffix per call defeats the memo so the raw hash loop is
+        // what gets measured.
+        let name = format!("some_rather_long_attribute_name_{:08x}", fastrand());
+        std::hint::black_box(hashname(std::hint::black_box(&name)));
+    });
+}
+
+// A tiny xorshift so the random-access benches do not measure a PRNG crate.
+fn fastrand() -> u64 {
+    use std::cell::Cell;
+    thread_local! {
+        static STATE: Cell<u64> = Cell::new(0x9e3779b97f4a7c15);
+    }
+    STATE.with(|state| {
+        let mut x = state.get();
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        state.set(x);
+        x
+    })
+}
+
+fn bench_dir2_data_entry() {
+    let mut block = vec![0u8; 4096];
+    let mut offset = 64;
+    let mut count = 0u64;
+    loop {
+        let name = format!("entry{:04}", count);
+        if offset + ((12 + name.len() + 7) & !7) > block.len() {
+            break;
+        }
+        offset = put_entry(&mut block, offset, 128 + count, name.as_bytes());
+        count += 1;
+    }
+
+    // Mark any leftover space unused so iteration stops at the last entry.
+    let remaining = block.len() - offset;
+    if remaining >= 4 {
+        block[offset..offset + 2].copy_from_slice(&0xffffu16.to_be_bytes());
+        block[offset + 2..offset + 4].copy_from_slice(&(remaining as u16).to_be_bytes());
+    }
+
+    bench("Dir2DataEntry::from (one entry)", 1_000_000, || {
+        let mut cursor = Cursor::new(&block);
+        cursor.set_position(64);
+        std::hint::black_box(Dir2DataEntry::from(&mut cursor));
+    });
+
+    bench(
+        &format!("Dir2DataEntryIter ({} entry block)", count),
+        100_000,
+        || {
+            let mut walked = 0;
+            for entry in Dir2DataEntryIter::new(&block, 64) {
+                std::hint::black_box(entry.inumber());
+                walked += 1;
+            }
+            assert_eq!(walked, count);
+        },
+    );
+}
+
+fn bench_extent_mapping() {
+    // A heavily fragmented file: 65536 single-block extents with gaps.
+    let bmx = (0..65536u64)
+        .map(|i| BmbtRec {
+            br_startoff: i * 2,
+            br_startblock: 1024 + i * 3,
+            br_blockcount: 1,
+            br_state: XfsExntst::Norm,
+        })
+        .collect::<Vec<BmbtRec>>();
+
+    let mut extents = FileExtentList {
+        bmx,
+        size: 65536 * 2 * 4096,
+        block_size: 4096,
+        hint: 0,
+    };
+
+    let mut logical = 0;
+    bench("FileExtentList::map_run (sequential)", 1_000_000, || {
+        std::hint::black_box(extents.map_logical_block_to_fs_block(logical));
+        logical = (logical + 2) % (65536 * 2);
+    });
+
+    bench("FileExtentList::map_run (random)", 1_000_000, || {
+        let block = (fastrand() % 65536) * 2;
+        std::hint::black_box(extents.map_logical_block_to_fs_block(block));
+    });
+}
+
+fn main() {
+    bench_hashname();
+    bench_dir2_data_entry();
+    bench_extent_mapping();
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+
+import argparse
+import os
+import random
+import time
+
+
+parser = argparse.ArgumentParser(
+    usage="%(prog)s mountpoint",
+    description="Measure readdir, lookup, and read rates of a mounted volume. "
+    "Point it at an xfs-fuse mountpoint of an image populated with many "
+    "directory entries and large files (see gen_attr_dump.py for the "
+    "image-generation approach).",
+)
+parser.add_argument("mountpoint", type=str)
+parser.add_argument("-s", "--seconds", type=float, default=5.0,
+                    help="minimum time to run each phase (default: 5)")
+parser.add_argument("-b", "--read-size", type=int, default=131072,
+                    help="read size in bytes (default: 131072)")
+args = vars(parser.parse_args())
+
+mountpoint = args["mountpoint"]
+seconds = args["seconds"]
+read_size = args["read_size"]
+
+
+def timed(func):
+    iterations = 0
+    units = 0
+    start = time.monotonic()
+    while time.monotonic() - start < seconds:
+        units += func()
+        iterations += 1
+    return units / (time.monotonic() - start)
+
+
+def readdir():
+    entries = 0
+    for _root, dirs, files in os.walk(mountpoint):
+        entries += len(dirs) + len(files)
+    return entries
+
+
+# Collect the tree once up front so the lookup and read phases know the names.
+paths = []
+for root, _dirs, files in os.walk(mountpoint):
+    for name in files:
+        paths.append(os.path.join(root, name))
+
+if not paths:
+    parser.error(f"no files under {mountpoint}")
+
+
+def lookup():
+    for path in paths:
+        os.stat(path)
+    return len(paths)
+
+
+large = [p for p in paths if os.path.getsize(p) >= read_size] or paths
+
+
+def sequential_read():
+    total = 0
+    for path in large:
+        with open(path, "rb", buffering=0) as f:
+            while True:
+                data = f.read(read_size)
+                if not data:
+                    break
+                total += len(data)
+    return total
+
+
+def random_read():
+    total = 0
+    for _i in range(len(large) * 8):
+        path = random.choice(large)
+        size = os.path.getsize(path)
+        with open(path, "rb", buffering=0) as f:
+            f.seek(random.randrange(max(size - read_size, 0) + 1))
+            total += len(f.read(read_size))
+    return total
+
+
+print(f"readdir:         {timed(readdir):14.0f} entries/s")
+print(f"lookup:          {timed(lookup):14.0f} lookups/s")
+print(f"sequential read: {timed(sequential_read) / 1048576:14.1f} MB/s")
+print(f"random read:     {timed(random_read) / 1048576:14.1f} MB/s")
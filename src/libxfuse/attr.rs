@@ -30,6 +30,7 @@ use std::{
     convert::TryInto,
     io::{BufRead, Seek, SeekFrom},
     mem::size_of,
+    sync::Mutex,
 };
 
 use byteorder::{BigEndian, ReadBytesExt};
@@ -51,6 +52,10 @@ pub const XFS_ATTR_SECURE: u8 = 1 << XFS_ATTR_SECURE_BIT;
 pub const XFS_ATTR_INCOMPLETE: u8 = 1 << XFS_ATTR_INCOMPLETE_BIT;
 pub const XFS_ATTR_NSP_ONDISK_MASK: u8 = XFS_ATTR_ROOT | XFS_ATTR_SECURE;
 
+// On-disk size of AttrRmtHdr; each remote value block carries this much
+// header before its data.
+pub const ATTR_RMT_HDR_SIZE: u32 = 56;
+
 pub fn get_namespace_from_flags(flags: u8) -> String {
     let namespace: String;
 
@@ -201,6 +206,63 @@ impl AttrLeafblock {
         AttrLeafblock { hdr, entries }
     }
 
+    // Decode every entry of this leaf in one pass for the xattr index:
+    // local values are captured inline, remote values as their resolved
+    // filesystem blocks so fetching them later needs no extent mapping.
+    pub fn index_entries<R: BufRead + Seek, F: Fn(XfsFileoff, &mut R) -> XfsFsblock>(
+        &self,
+        buf_reader: &mut R,
+        super_block: &Sb,
+        leaf_offset: u64,
+        map_logical_block_to_fs_block: F,
+        entries: &mut Vec<XattrIndexEntry>,
+    ) {
+        for entry in self.entries.iter() {
+            buf_reader.seek(SeekFrom::Start(leaf_offset)).unwrap();
+            buf_reader
+                .seek(SeekFrom::Current(i64::from(entry.nameidx)))
+                .unwrap();
+
+            if entry.flags & XFS_ATTR_LOCAL == 0 {
+                let name_entry = AttrLeafNameLocal::from(buf_reader.by_ref());
+                let namelen = name_entry.namelen as usize;
+
+                entries.push(XattrIndexEntry {
+                    name: String::from_utf8_lossy(&name_entry.nameval[0..namelen]).into_owned(),
+                    flags: entry.flags,
+                    size: name_entry.valuelen.into(),
+                    value: Mutex::new(XattrValue::Local(name_entry.nameval[namelen..].to_vec())),
+                });
+            } else {
+                let name_entry = AttrLeafNameRemote::from(buf_reader.by_ref());
+                let namelen = name_entry.namelen as usize;
+
+                // Resolve the value's blocks now, while the extent map is
+                // at hand; the data itself is fetched on first read.
+                let per_block = super_block.sb_blocksize - ATTR_RMT_HDR_SIZE;
+                let nblocks = (name_entry.valuelen + per_block - 1) / per_block;
+                let blocks: Vec<XfsFsblock> = (0..nblocks)
+                    .map(|i| {
+                        map_logical_block_to_fs_block(
+                            u64::from(name_entry.valueblk) + u64::from(i),
+                            buf_reader.by_ref(),
+                        )
+                    })
+                    .collect();
+
+                entries.push(XattrIndexEntry {
+                    name: String::from_utf8_lossy(&name_entry.name[0..namelen]).into_owned(),
+                    flags: entry.flags,
+                    size: name_entry.valuelen,
+                    value: Mutex::new(XattrValue::Remote {
+                        blocks,
+                        valuelen: name_entry.valuelen,
+                    }),
+                });
+            }
+        }
+    }
+
     pub fn get_total_size<R: BufRead + Seek>(
         &mut self,
         buf_reader: &mut R,
@@ -449,7 +511,7 @@ impl AttrRmtHdr {
             .seek(SeekFrom::Start(start_offset + u64::from(rm_offset)))
             .unwrap();
 
-        let mut data = Vec::<u8>::with_capacity(rm_bytes as usize);
+        let mut data = vec![0u8; rm_bytes as usize];
         buf_reader.read_exact(&mut data).unwrap();
 
         (
@@ -468,6 +530,108 @@ impl AttrRmtHdr {
     }
 }
 
+// Where an attribute's value lives: decoded inline, or in remote blocks
+// that are fetched and cached in place on first read.
+#[derive(Debug)]
+pub enum XattrValue {
+    Local(Vec<u8>),
+    Remote {
+        blocks: Vec<XfsFsblock>,
+        valuelen: u32,
+    },
+}
+
+#[derive(Debug)]
+pub struct XattrIndexEntry {
+    pub name: String,
+    pub flags: u8,
+    pub size: u32,
+    pub value: Mutex<XattrValue>,
+}
+
+// All of an inode's attributes, decoded in one pass over the leaf chain
+// and sorted by name.  Once built, getxattr and listxattr are answered
+// from here without touching the attr blocks again.
+#[derive(Debug)]
+pub struct XattrIndex {
+    pub entries: Vec<XattrIndexEntry>,
+    pub total_size: u32,
+}
+
+impl XattrIndex {
+    pub fn new(mut entries: Vec<XattrIndexEntry>) -> XattrIndex {
+        entries.sort_unstable_by(|a, b| a.name.cmp(&b.name));
+
+        let total_size = entries
+            .iter()
+            .map(|entry| {
+                get_namespace_size_from_flags(entry.flags) + entry.name.len() as u32 + 1
+            })
+            .sum();
+
+        XattrIndex {
+            entries,
+            total_size,
+        }
+    }
+
+    fn find(&self, name: &str) -> &XattrIndexEntry {
+        let pos = self
+            .entries
+            .binary_search_by(|entry| entry.name.as_str().cmp(name))
+            .expect("Couldn't find the attribute entry");
+
+        &self.entries[pos]
+    }
+
+    pub fn get_size(&self, name: &str) -> u32 {
+        self.find(name).size
+    }
+
+    pub fn list(&self) -> Vec<u8> {
+        let mut list: Vec<u8> = Vec::with_capacity(self.total_size as usize);
+
+        for entry in self.entries.iter() {
+            list.extend_from_slice(get_namespace_from_flags(entry.flags).as_bytes());
+            list.extend_from_slice(entry.name.as_bytes());
+            list.push(0)
+        }
+
+        list
+    }
+
+    pub fn get<R: BufRead + Seek>(
+        &self,
+        buf_reader: &mut R,
+        super_block: &Sb,
+        name: &str,
+    ) -> Vec<u8> {
+        let entry = self.find(name);
+
+        let mut value = entry.value.lock().unwrap();
+        if let XattrValue::Remote { blocks, valuelen } = &*value {
+            let mut res: Vec<u8> = Vec::with_capacity(*valuelen as usize);
+
+            for blk in blocks {
+                buf_reader
+                    .seek(SeekFrom::Start(blk * u64::from(super_block.sb_blocksize)))
+                    .unwrap();
+
+                let (_, data) = AttrRmtHdr::from(buf_reader.by_ref());
+                res.extend(data);
+            }
+            res.truncate(*valuelen as usize);
+
+            *value = XattrValue::Local(res);
+        }
+
+        match &*value {
+            XattrValue::Local(data) => data.clone(),
+            XattrValue::Remote { .. } => unreachable!(),
+        }
+    }
+}
+
 pub trait Attr<R: BufRead + Seek> {
     fn get_total_size(&mut self, buf_reader: &mut R, super_block: &Sb) -> u32;
 
@@ -476,4 +640,7 @@ pub trait Attr<R: BufRead + Seek> {
     fn list(&mut self, buf_reader: &mut R, super_block: &Sb) -> Vec<u8>;
 
     fn get(&self, buf_reader: &mut R, super_block: &Sb, name: &str) -> Vec<u8>;
+
+    // Decode every attribute in one pass for the per-inode xattr index.
+    fn index(&mut self, buf_reader: &mut R, super_block: &Sb) -> Vec<XattrIndexEntry>;
 }
@@ -31,7 +31,7 @@ use std::{
 };
 
 use super::{
-    attr::{Attr, AttrLeafblock},
+    attr::{Attr, AttrLeafblock, XattrIndexEntry},
     btree::Btree,
     da_btree::{hashname, XfsDa3Intnode},
     sb::Sb,
@@ -159,4 +159,51 @@ impl<R: BufRead + Seek> Attr<R> for AttrBtree {
             |block, reader| self.btree.map_block(reader.by_ref(), super_block, block),
         )
     }
+
+    fn index(&mut self, buf_reader: &mut R, super_block: &Sb) -> Vec<XattrIndexEntry> {
+        let mut entries = Vec::new();
+
+        let blk = self.btree.map_block(buf_reader.by_ref(), super_block, 0);
+        buf_reader
+            .seek(SeekFrom::Start(blk * u64::from(super_block.sb_blocksize)))
+            .unwrap();
+
+        let node = XfsDa3Intnode::from(buf_reader.by_ref(), super_block);
+
+        let blk = node.first_block(buf_reader.by_ref(), super_block, |block, reader| {
+            self.btree
+                .map_block(reader.by_ref(), super_block, block.into())
+        });
+        let mut leaf_offset = blk * u64::from(super_block.sb_blocksize);
+
+        buf_reader.seek(SeekFrom::Start(leaf_offset)).unwrap();
+        let mut leaf = AttrLeafblock::from(buf_reader.by_ref(), super_block);
+
+        loop {
+            leaf.index_entries(
+                buf_reader.by_ref(),
+                super_block,
+                leaf_offset,
+                |block, reader| {
+                    self.btree
+                        .map_block(reader.by_ref(), super_block, block)
+                },
+                &mut entries,
+            );
+
+            if leaf.hdr.info.forw == 0 {
+                break;
+            }
+
+            let blk = self
+                .btree
+                .map_block(buf_reader.by_ref(), super_block, leaf.hdr.info.forw.into());
+            leaf_offset = blk * u64::from(super_block.sb_blocksize);
+
+            buf_reader.seek(SeekFrom::Start(leaf_offset)).unwrap();
+            leaf = AttrLeafblock::from(buf_reader.by_ref(), super_block);
+        }
+
+        entries
+    }
 }
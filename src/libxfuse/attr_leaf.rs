@@ -31,7 +31,7 @@ use std::{
 };
 
 use super::{
-    attr::{Attr, AttrLeafblock},
+    attr::{Attr, AttrLeafblock, XattrIndexEntry},
     bmbt_rec::BmbtRec,
     da_btree::hashname,
     definitions::{XfsFileoff, XfsFsblock},
@@ -122,6 +122,20 @@ impl<R: BufRead + Seek> Attr<R> for AttrLeaf {
             |block, _| self.map_logical_block_to_actual_block(block),
         )
     }
+
+    fn index(&mut self, buf_reader: &mut R, super_block: &Sb) -> Vec<XattrIndexEntry> {
+        let mut entries = Vec::with_capacity(self.leaf.entries.len());
+
+        self.leaf.index_entries(
+            buf_reader.by_ref(),
+            super_block,
+            self.leaf_offset,
+            |block, _| self.map_logical_block_to_actual_block(block),
+            &mut entries,
+        );
+
+        entries
+    }
 }
 
 #[cfg(test)]
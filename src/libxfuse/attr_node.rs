@@ -31,7 +31,7 @@ use std::{
 };
 
 use super::{
-    attr::{Attr, AttrLeafblock},
+    attr::{Attr, AttrLeafblock, XattrIndexEntry},
     bmbt_rec::BmbtRec,
     da_btree::{hashname, XfsDa3Intnode},
     definitions::{XfsFileoff, XfsFsblock},
@@ -244,4 +244,40 @@ impl<R: BufRead + Seek> Attr<R> for AttrNode {
             |block, _| self.map_logical_block_to_fs_block(block),
         )
     }
+
+    fn index(&mut self, buf_reader: &mut R, super_block: &Sb) -> Vec<XattrIndexEntry> {
+        let mut entries = Vec::new();
+
+        let blk = self
+            .node
+            .first_block(buf_reader.by_ref(), super_block, |block, _| {
+                self.map_logical_block_to_fs_block(block.into())
+            });
+        let mut leaf_offset = blk * u64::from(super_block.sb_blocksize);
+
+        buf_reader.seek(SeekFrom::Start(leaf_offset)).unwrap();
+        let mut leaf = AttrLeafblock::from(buf_reader.by_ref(), super_block);
+
+        loop {
+            leaf.index_entries(
+                buf_reader.by_ref(),
+                super_block,
+                leaf_offset,
+                |block, _| self.map_logical_block_to_fs_block(block),
+                &mut entries,
+            );
+
+            if leaf.hdr.info.forw == 0 {
+                break;
+            }
+
+            let blk = self.map_logical_block_to_fs_block(leaf.hdr.info.forw.into());
+            leaf_offset = blk * u64::from(super_block.sb_blocksize);
+
+            buf_reader.seek(SeekFrom::Start(leaf_offset)).unwrap();
+            leaf = AttrLeafblock::from(buf_reader.by_ref(), super_block);
+        }
+
+        entries
+    }
 }
@@ -27,8 +27,10 @@
  */
 use std::io::{BufRead, Seek};
 
+use std::sync::Mutex;
+
 use super::{
-    attr::{get_namespace_from_flags, get_namespace_size_from_flags, Attr},
+    attr::{get_namespace_from_flags, get_namespace_size_from_flags, Attr, XattrIndexEntry, XattrValue},
     sb::Sb,
 };
 
@@ -64,6 +66,10 @@ pub struct AttrSfEntry {
 }
 
 impl AttrSfEntry {
+    pub fn name(&self) -> &[u8] {
+        &self.nameval[0..(self.namelen as usize)]
+    }
+
     pub fn from<R: BufRead>(buf_reader: &mut R) -> AttrSfEntry {
         let namelen = buf_reader.read_u8().unwrap();
         let valuelen = buf_reader.read_u8().unwrap();
@@ -88,6 +94,10 @@ pub struct AttrShortform {
     pub hdr: AttrSfHdr,
     pub list: Vec<AttrSfEntry>,
 
+    // Entry indices sorted by name, built once at parse time so every get
+    // against this (cached) inode is a binary search instead of a scan.
+    pub by_name: Vec<u8>,
+
     pub total_size: u32,
 }
 
@@ -104,12 +114,24 @@ impl AttrShortform {
             list.push(entry);
         }
 
+        let mut by_name: Vec<u8> = (0..list.len() as u8).collect();
+        by_name.sort_unstable_by(|a, b| list[*a as usize].name().cmp(list[*b as usize].name()));
+
         AttrShortform {
             hdr,
             list,
+            by_name,
             total_size,
         }
     }
+
+    // Binary search the name index for an entry.
+    fn find(&self, name: &str) -> Option<&AttrSfEntry> {
+        self.by_name
+            .binary_search_by(|i| self.list[*i as usize].name().cmp(name.as_bytes()))
+            .ok()
+            .map(|pos| &self.list[self.by_name[pos] as usize])
+    }
 }
 
 impl<R: BufRead + Seek> Attr<R> for AttrShortform {
@@ -118,15 +140,9 @@ impl<R: BufRead + Seek> Attr<R> for AttrShortform {
     }
 
     fn get_size(&self, _buf_reader: &mut R, _super_block: &Sb, name: &str) -> u32 {
-        for entry in &self.list {
-            let entry_name = entry.nameval[0..(entry.namelen as usize)].to_vec();
+        let entry = self.find(name).expect("Couldn't find entry!");
 
-            if name.as_bytes().to_vec() == entry_name {
-                return entry.valuelen.into();
-            }
-        }
-
-        panic!("Couldn't find entry!");
+        entry.valuelen.into()
     }
 
     fn list(&mut self, buf_reader: &mut R, super_block: &Sb) -> Vec<u8> {
@@ -144,16 +160,62 @@ impl<R: BufRead + Seek> Attr<R> for AttrShortform {
     }
 
     fn get(&self, _buf_reader: &mut R, _super_block: &Sb, name: &str) -> Vec<u8> {
-        for entry in &self.list {
-            let entry_name = entry.nameval[0..(entry.namelen as usize)].to_vec();
+        let entry = self.find(name).expect("Couldn't find entry!");
 
-            if name.as_bytes().to_vec() == entry_name {
-                let namelen = entry.namelen as usize;
+        entry.nameval[(entry.namelen as usize)..].to_vec()
+    }
 
-                return entry.nameval[namelen..].to_vec();
-            }
+    fn index(&mut self, _buf_reader: &mut R, _super_block: &Sb) -> Vec<XattrIndexEntry> {
+        self.list
+            .iter()
+            .map(|entry| XattrIndexEntry {
+                name: String::from_utf8_lossy(entry.name()).into_owned(),
+                flags: entry.flags,
+                size: entry.valuelen.into(),
+                value: Mutex::new(XattrValue::Local(
+                    entry.nameval[(entry.namelen as usize)..].to_vec(),
+                )),
+            })
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::io::Cursor;
+
+    use super::*;
+
+    #[test]
+    fn name_index_resolves_attrs_in_any_order() {
+        // A shortform attr fork with three entries, deliberately not in
+        // name order: "zeta" = "z", "alpha" = "aa", "mid" = "mmm".
+        let mut raw = vec![0u8, 0, 3, 0];
+        for (name, value) in [
+            (b"zeta".as_slice(), b"z".as_slice()),
+            (b"alpha".as_slice(), b"aa".as_slice()),
+            (b"mid".as_slice(), b"mmm".as_slice()),
+        ] {
+            raw.push(name.len() as u8);
+            raw.push(value.len() as u8);
+            raw.push(0);
+            raw.extend_from_slice(name);
+            raw.extend_from_slice(value);
         }
 
-        panic!("Couldn't find entry!");
+        let attrs = AttrShortform::from(&mut Cursor::new(&raw));
+
+        // The index is sorted by name regardless of on-disk order.
+        let names: Vec<&[u8]> = attrs
+            .by_name
+            .iter()
+            .map(|i| attrs.list[*i as usize].name())
+            .collect();
+        assert_eq!(names, vec![b"alpha".as_slice(), b"mid", b"zeta"]);
+
+        assert_eq!(attrs.find("alpha").unwrap().nameval[5..], *b"aa");
+        assert_eq!(attrs.find("mid").unwrap().nameval[3..], *b"mmm");
+        assert_eq!(attrs.find("zeta").unwrap().valuelen, 1);
+        assert!(attrs.find("missing").is_none());
     }
 }
@@ -27,8 +27,10 @@
  */
 use std::{
     cmp::Ordering,
+    collections::HashMap,
     io::{prelude::*, SeekFrom},
     mem,
+    sync::{Arc, Mutex},
 };
 
 use byteorder::{BigEndian, LittleEndian, ReadBytesExt};
@@ -42,6 +44,7 @@ use super::{
 };
 
 pub const POINTERS_AREA_OFFSET: u16 = 0x808;
+pub const NULLFSBLOCK: XfsFsblock = !0;
 
 #[derive(Debug)]
 pub struct BtreeBlock<T: PrimInt + Unsigned> {
@@ -130,111 +133,140 @@ pub type XfsBmbtPtr = XfsFsblock;
 pub type XfsBmdrPtr = XfsFsblock;
 pub type XfsBmbtBlock = BtreeBlock<u64>;
 
+// A decoded interior node: the keys to search and the child pointers to
+// follow.
+#[derive(Debug)]
+struct BtreeNode {
+    keys: Vec<BmbtKey>,
+    ptrs: Vec<XfsBmbtPtr>,
+}
+
 #[derive(Debug, Clone)]
 pub struct Btree {
     pub bmdr: BmdrBlock,
     pub keys: Vec<BmbtKey>,
     pub ptrs: Vec<XfsBmbtPtr>,
+    // Decoded interior nodes keyed by fsblock, shared by clones of this
+    // tree.  Interior nodes are a tiny fraction of the tree and are hit on
+    // every mapping, so once decoded the descent costs no I/O or parsing.
+    node_cache: Arc<Mutex<HashMap<XfsFsblock, Arc<BtreeNode>>>>,
 }
 
 impl Btree {
+    pub fn new(bmdr: BmdrBlock, keys: Vec<BmbtKey>, ptrs: Vec<XfsBmbtPtr>) -> Btree {
+        Btree {
+            bmdr,
+            keys,
+            ptrs,
+            node_cache: Default::default(),
+        }
+    }
+
+    // Index of the last key at or before the logical block.
+    fn predecessor(keys: &[BmbtKey], logical_block: XfsFileoff) -> usize {
+        let idx = keys.partition_point(|key| key.br_startoff <= logical_block);
+        idx.saturating_sub(1)
+    }
+
     pub fn map_block<R: BufRead + Seek>(
         &self,
         buf_reader: &mut R,
         super_block: &Sb,
         logical_block: XfsFileoff,
     ) -> XfsFsblock {
-        let mut low: i64 = 0;
-        let mut high: i64 = (self.bmdr.bb_numrecs - 1) as i64;
+        let rec = self.leaf_record(buf_reader, super_block, logical_block);
 
-        let mut predecessor = 0;
+        rec.br_startblock + (logical_block - rec.br_startoff)
+    }
 
-        while low <= high {
-            let mid = low + ((high - low) / 2);
+    // Map a logical block to its filesystem block plus the number of
+    // contiguous blocks from there to the end of the extent, so callers can
+    // cover the whole run with one read.
+    pub fn map_run<R: BufRead + Seek>(
+        &self,
+        buf_reader: &mut R,
+        super_block: &Sb,
+        logical_block: XfsFileoff,
+    ) -> (XfsFsblock, u64) {
+        let rec = self.leaf_record(buf_reader, super_block, logical_block);
 
-            let key = self.keys[mid as usize].br_startoff;
+        let delta = logical_block - rec.br_startoff;
+        let run = if delta < rec.br_blockcount {
+            rec.br_blockcount - delta
+        } else {
+            1
+        };
 
-            match key.cmp(&logical_block) {
-                Ordering::Greater => {
-                    high = mid - 1;
-                }
-                Ordering::Less => {
-                    low = mid + 1;
-                    predecessor = mid;
-                }
-                Ordering::Equal => {
-                    predecessor = mid;
-                    break;
-                }
-            }
+        (rec.br_startblock + delta, run)
+    }
+
+    // Fetch the interior node at the given fsblock through the node cache,
+    // decoding it from disk on a miss.  Returns None if the block is a leaf.
+    fn interior_node<R: BufRead + Seek>(
+        &self,
+        buf_reader: &mut R,
+        super_block: &Sb,
+        ptr: XfsFsblock,
+    ) -> Option<Arc<BtreeNode>> {
+        if let Some(node) = self.node_cache.lock().unwrap().get(&ptr) {
+            return Some(node.clone());
+        }
+
+        buf_reader
+            .seek(SeekFrom::Start(ptr * u64::from(super_block.sb_blocksize)))
+            .unwrap();
+
+        let bmbt_block = XfsBmbtBlock::from(buf_reader.by_ref(), super_block);
+        if bmbt_block.bb_level == 0 {
+            return None;
+        }
+
+        let mut keys = Vec::with_capacity(bmbt_block.bb_numrecs.into());
+        for _i in 0..bmbt_block.bb_numrecs {
+            keys.push(BmbtKey::from(buf_reader.by_ref()));
         }
 
         buf_reader
             .seek(SeekFrom::Start(
-                self.ptrs[predecessor as usize] * u64::from(super_block.sb_blocksize),
+                (ptr * u64::from(super_block.sb_blocksize)) + u64::from(POINTERS_AREA_OFFSET),
             ))
             .unwrap();
 
-        let mut bmbt_block = XfsBmbtBlock::from(buf_reader.by_ref(), super_block);
-        let mut keys_offset = buf_reader.stream_position().unwrap();
-
-        loop {
-            if bmbt_block.bb_level == 0 {
-                break;
-            } else {
-                let mut low: i64 = 0;
-                let mut high: i64 = (bmbt_block.bb_numrecs - 1) as i64;
-
-                let mut predecessor = 0;
-
-                while low <= high {
-                    let mid = low + ((high - low) / 2);
-
-                    buf_reader.seek(SeekFrom::Start(keys_offset)).unwrap();
-                    buf_reader
-                        .seek(SeekFrom::Current(mid * (mem::size_of::<BmbtKey>() as i64)))
-                        .unwrap();
-
-                    let key = BmbtKey::from(buf_reader.by_ref()).br_startoff;
-
-                    match key.cmp(&logical_block) {
-                        Ordering::Greater => {
-                            high = mid - 1;
-                        }
-                        Ordering::Less => {
-                            low = mid + 1;
-                            predecessor = mid;
-                        }
-                        Ordering::Equal => {
-                            predecessor = mid;
-                            break;
-                        }
-                    }
-                }
+        let mut ptrs = Vec::with_capacity(bmbt_block.bb_numrecs.into());
+        for _i in 0..bmbt_block.bb_numrecs {
+            ptrs.push(buf_reader.read_u64::<BigEndian>().unwrap());
+        }
 
-                buf_reader
-                    .seek(SeekFrom::Start(
-                        keys_offset - (mem::size_of::<XfsBmbtBlock>() as u64)
-                            + u64::from(POINTERS_AREA_OFFSET),
-                    ))
-                    .unwrap();
-                buf_reader.seek(SeekFrom::Current(predecessor * 8)).unwrap();
+        let node = Arc::new(BtreeNode { keys, ptrs });
+        self.node_cache.lock().unwrap().insert(ptr, node.clone());
 
-                let ptr = buf_reader.read_u64::<BigEndian>().unwrap();
+        Some(node)
+    }
 
-                buf_reader
-                    .seek(SeekFrom::Start(ptr * u64::from(super_block.sb_blocksize)))
-                    .unwrap();
+    // Walk the tree down to the leaf record covering the logical block.
+    fn leaf_record<R: BufRead + Seek>(
+        &self,
+        buf_reader: &mut R,
+        super_block: &Sb,
+        logical_block: XfsFileoff,
+    ) -> BmbtRec {
+        let mut ptr = self.ptrs[Btree::predecessor(&self.keys, logical_block)];
 
-                bmbt_block = XfsBmbtBlock::from(buf_reader.by_ref(), super_block);
-                keys_offset = buf_reader.stream_position().unwrap();
-            }
+        // Descend through the interior levels out of the node cache.
+        while let Some(node) = self.interior_node(buf_reader.by_ref(), super_block, ptr) {
+            ptr = node.ptrs[Btree::predecessor(&node.keys, logical_block)];
         }
 
+        let bmbt_block_numrecs = {
+            buf_reader
+                .seek(SeekFrom::Start(ptr * u64::from(super_block.sb_blocksize)))
+                .unwrap();
+            XfsBmbtBlock::from(buf_reader.by_ref(), super_block).bb_numrecs
+        };
         let recs_offset = buf_reader.stream_position().unwrap();
 
         let mut low: i64 = 0;
-        let mut high: i64 = (bmbt_block.bb_numrecs - 1) as i64;
+        let mut high: i64 = (bmbt_block_numrecs - 1) as i64;
 
         let mut predecessor = 0;
 
@@ -270,8 +302,131 @@ impl Btree {
             ))
             .unwrap();
 
-        let rec = BmbtRec::from(buf_reader.by_ref());
+        BmbtRec::from(buf_reader.by_ref())
+    }
 
-        rec.br_startblock + (logical_block - rec.br_startoff)
+    // Decode a whole leaf: its record array and the right sibling pointer.
+    fn load_leaf<R: BufRead + Seek>(
+        buf_reader: &mut R,
+        super_block: &Sb,
+        ptr: XfsFsblock,
+    ) -> (Vec<BmbtRec>, XfsFsblock) {
+        buf_reader
+            .seek(SeekFrom::Start(ptr * u64::from(super_block.sb_blocksize)))
+            .unwrap();
+
+        let bmbt_block = XfsBmbtBlock::from(buf_reader.by_ref(), super_block);
+
+        let mut recs = Vec::with_capacity(bmbt_block.bb_numrecs.into());
+        for _i in 0..bmbt_block.bb_numrecs {
+            recs.push(BmbtRec::from(buf_reader.by_ref()));
+        }
+
+        (recs, bmbt_block.bb_rightsib)
+    }
+
+    // Position an extent iterator at the leaf covering the logical block.
+    // One descent per read request; the iterator then walks records and
+    // sibling leaves in order.
+    pub fn extent_iter<R: BufRead + Seek>(
+        &self,
+        buf_reader: &mut R,
+        super_block: &Sb,
+        logical_block: XfsFileoff,
+    ) -> BtreeExtentIter {
+        let mut ptr = self.ptrs[Btree::predecessor(&self.keys, logical_block)];
+
+        while let Some(node) = self.interior_node(buf_reader.by_ref(), super_block, ptr) {
+            ptr = node.ptrs[Btree::predecessor(&node.keys, logical_block)];
+        }
+
+        let (recs, rightsib) = Btree::load_leaf(buf_reader.by_ref(), super_block, ptr);
+        let idx = recs
+            .partition_point(|rec| rec.br_startoff <= logical_block)
+            .saturating_sub(1);
+
+        BtreeExtentIter {
+            recs,
+            idx,
+            rightsib,
+        }
+    }
+}
+
+// A cursor over the leaf level of a bmbt: the records of the current leaf
+// plus the sibling to walk to when they run out.  Mapping consecutive
+// logical blocks costs no descent however deep the tree is.
+#[derive(Debug)]
+pub struct BtreeExtentIter {
+    recs: Vec<BmbtRec>,
+    idx: usize,
+    rightsib: XfsFsblock,
+}
+
+impl BtreeExtentIter {
+    // Map a logical block at or after the last one mapped to its filesystem
+    // block plus the length of the contiguous run from there.
+    // The next leaf record in logical order, crossing into sibling leaves
+    // as each one is consumed; None once the leaf level ends.
+    pub fn next_record<R: BufRead + Seek>(
+        &mut self,
+        buf_reader: &mut R,
+        super_block: &Sb,
+    ) -> Option<BmbtRec> {
+        if self.idx >= self.recs.len() {
+            if self.rightsib == NULLFSBLOCK {
+                return None;
+            }
+
+            let (recs, rightsib) = Btree::load_leaf(buf_reader.by_ref(), super_block, self.rightsib);
+            if recs.is_empty() {
+                return None;
+            }
+            self.recs = recs;
+            self.rightsib = rightsib;
+            self.idx = 0;
+        }
+
+        let rec = self.recs[self.idx].clone();
+        self.idx += 1;
+        Some(rec)
+    }
+
+    pub fn map_run<R: BufRead + Seek>(
+        &mut self,
+        buf_reader: &mut R,
+        super_block: &Sb,
+        logical_block: XfsFileoff,
+    ) -> (XfsFsblock, u64) {
+        loop {
+            let rec = &self.recs[self.idx];
+            if logical_block >= rec.br_startoff
+                && logical_block - rec.br_startoff < rec.br_blockcount
+            {
+                let delta = logical_block - rec.br_startoff;
+                return (rec.br_startblock + delta, rec.br_blockcount - delta);
+            }
+
+            if self.idx + 1 < self.recs.len() {
+                if self.recs[self.idx + 1].br_startoff <= logical_block {
+                    self.idx += 1;
+                    continue;
+                }
+            } else if self.rightsib != NULLFSBLOCK {
+                let (recs, rightsib) =
+                    Btree::load_leaf(buf_reader.by_ref(), super_block, self.rightsib);
+                if !recs.is_empty() && recs[0].br_startoff <= logical_block {
+                    self.recs = recs;
+                    self.rightsib = rightsib;
+                    self.idx = 0;
+                    continue;
+                }
+            }
+
+            // In a hole past the record: map one block at a time, like the
+            // extent list does.
+            let delta = logical_block - rec.br_startoff;
+            return (rec.br_startblock + delta, 1);
+        }
     }
 }
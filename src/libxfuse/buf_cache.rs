@@ -0,0 +1,354 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+use std::fs::File;
+use std::io::{self, BufRead, Read, Seek, SeekFrom};
+use std::os::unix::fs::FileExt;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex};
+
+use super::buf_pool::pool;
+use super::cache::Lru;
+use super::checksum::{verify_block, CrcCheckMode};
+use super::definitions::XfsFsblock;
+use super::io_backend::{IoBackend, ReadRequest};
+use super::mmap::Mmap;
+use super::stats::stats;
+
+pub const BUFFER_CACHE_SHARDS: usize = 8;
+
+// A cached block plus whether its checksum has been verified during this
+// cache residency; eviction discards the bit along with the data.
+#[derive(Debug)]
+struct Frame {
+    data: Arc<[u8]>,
+    verified: AtomicBool,
+}
+
+// A shared cache of filesystem-block-sized frames keyed by fsblock number.
+// The LRU is sharded so that concurrent readers do not all contend on one
+// lock.  Frames are immutable once loaded (the filesystem is read-only) and
+// are handed out as Arc<[u8]>.
+//
+// In mmap mode the device is mapped once instead and readers are served
+// slices of the mapping directly; the kernel page cache takes the place of
+// the frame LRU.
+#[derive(Debug)]
+pub struct BufferCache {
+    block_size: u32,
+    device_size: u64,
+    shards: Vec<Mutex<Lru<XfsFsblock, Arc<Frame>>>>,
+    mmap: Option<Mmap>,
+    // Backend for batched file-data reads; metadata frames go through the
+    // plain positioned reads above instead.
+    io: Arc<dyn IoBackend>,
+    crc_check: CrcCheckMode,
+    // When directory blocks span several frames their checksum does not
+    // cover a single frame; the engine skips them.
+    dir_spans_frames: bool,
+}
+
+impl BufferCache {
+    pub fn new(
+        block_size: u32,
+        cache_bytes: usize,
+        device: &File,
+        use_mmap: bool,
+        io: Arc<dyn IoBackend>,
+        crc_check: CrcCheckMode,
+        dir_spans_frames: bool,
+    ) -> BufferCache {
+        let frames = std::cmp::max(cache_bytes / (block_size as usize), BUFFER_CACHE_SHARDS);
+        let per_shard = frames / BUFFER_CACHE_SHARDS;
+
+        let mut shards = Vec::with_capacity(BUFFER_CACHE_SHARDS);
+        for _i in 0..BUFFER_CACHE_SHARDS {
+            shards.push(Mutex::new(Lru::new(per_shard)));
+        }
+
+        let mmap = if use_mmap { Mmap::new(device) } else { None };
+
+        BufferCache {
+            block_size,
+            device_size: device.metadata().unwrap().len(),
+            shards,
+            mmap,
+            io,
+            crc_check,
+            dir_spans_frames,
+        }
+    }
+
+    pub fn mmap(&self) -> Option<&Mmap> {
+        self.mmap.as_ref()
+    }
+
+    pub fn io(&self) -> &dyn IoBackend {
+        self.io.as_ref()
+    }
+
+    pub fn block_size(&self) -> u32 {
+        self.block_size
+    }
+
+    pub fn device_size(&self) -> u64 {
+        self.device_size
+    }
+
+    // Return the frame covering the given fsblock, reading it from the
+    // device on a miss.  The shard lock is dropped during the device read so
+    // a cold block does not stall unrelated lookups; two threads racing on
+    // the same block simply read it twice.
+    pub fn frame(&self, device: &File, blk: XfsFsblock) -> Arc<[u8]> {
+        let shard = &self.shards[(blk as usize) % BUFFER_CACHE_SHARDS];
+
+        let cached = shard.lock().unwrap().get(&blk);
+        let frame = match cached {
+            Some(frame) => {
+                stats().block_cache.hit();
+                frame
+            }
+            None => {
+                stats().block_cache.miss();
+                let frame = Arc::new(Frame {
+                    data: self.read_frame(device, blk),
+                    verified: AtomicBool::new(false),
+                });
+                shard.lock().unwrap().insert(blk, frame.clone());
+                frame
+            }
+        };
+
+        match self.crc_check {
+            CrcCheckMode::Off => {}
+            CrcCheckMode::Lazy => {
+                if !frame.verified.load(Ordering::Relaxed) {
+                    self.verify(blk, &frame.data);
+                    frame.verified.store(true, Ordering::Relaxed);
+                }
+            }
+            CrcCheckMode::Always => self.verify(blk, &frame.data),
+        }
+
+        frame.data.clone()
+    }
+
+    fn verify(&self, blk: XfsFsblock, data: &[u8]) {
+        if !verify_block(data, self.dir_spans_frames) {
+            panic!("Crc check failed for block {}!", blk);
+        }
+    }
+
+    fn read_frame(&self, device: &File, blk: XfsFsblock) -> Arc<[u8]> {
+        let mut buf = vec![0u8; self.block_size as usize];
+        let offset = blk * u64::from(self.block_size);
+
+        let mut filled = 0;
+        while filled < buf.len() {
+            match device.read_at(&mut buf[filled..], offset + (filled as u64)) {
+                Ok(0) => break,
+                Ok(n) => filled += n,
+                Err(ref err) if err.kind() == io::ErrorKind::Interrupted => continue,
+                Err(err) => panic!("Device read failed: {}", err),
+            }
+        }
+        buf.truncate(filled);
+
+        buf.into()
+    }
+}
+
+// A positioned reader over the device that satisfies BufRead + Seek by
+// serving block-sized frames out of a shared BufferCache, so every metadata
+// parser reads through the cache without modification.
+#[derive(Debug)]
+pub struct BlockReader<'a> {
+    device: &'a File,
+    cache: &'a BufferCache,
+    pos: u64,
+    frame_blk: XfsFsblock,
+    frame: Option<Arc<[u8]>>,
+}
+
+// A contiguous run of device bytes handed out for zero-copy parsing: a
+// slice of the mapping in mmap mode, a reference-counted cache frame when
+// the run fits in one, and an assembled copy only when it spans frames.
+#[derive(Debug)]
+pub enum BlockSlice<'a> {
+    Mapped(&'a [u8]),
+    Frame(Arc<[u8]>, std::ops::Range<usize>),
+}
+
+impl std::ops::Deref for BlockSlice<'_> {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        match self {
+            BlockSlice::Mapped(data) => data,
+            BlockSlice::Frame(frame, range) => &frame[range.clone()],
+        }
+    }
+}
+
+impl<'a> BlockReader<'a> {
+    pub fn new(device: &'a File, cache: &'a BufferCache) -> BlockReader<'a> {
+        BlockReader {
+            device,
+            cache,
+            pos: 0,
+            frame_blk: 0,
+            frame: None,
+        }
+    }
+
+    // Fetch several disjoint device ranges into out, each at its tag
+    // offset.  Served straight from the mapping in mmap mode; otherwise the
+    // ranges go to the I/O backend as one batch, so the reads of one
+    // request are in flight concurrently and complete in any order.
+    pub fn read_scatter(&mut self, requests: Vec<ReadRequest>, out: &mut [u8]) {
+        if let Some(map) = self.cache.mmap() {
+            let data = map.as_slice();
+            for request in requests {
+                let start = std::cmp::min(request.offset as usize, data.len());
+                let end = std::cmp::min(start + request.len, data.len());
+                out[request.tag..request.tag + (end - start)]
+                    .copy_from_slice(&data[start..end]);
+            }
+            return;
+        }
+
+        for completion in self.cache.io().submit(requests) {
+            let end = completion.tag + completion.data.len();
+            out[completion.tag..end].copy_from_slice(&completion.data);
+            pool().put(completion.data);
+        }
+    }
+
+    // Return the len bytes at the given device offset as one contiguous
+    // slice, without copying unless the run crosses a frame boundary.
+    pub fn block(&mut self, offset: u64, len: usize) -> BlockSlice<'a> {
+        if let Some(map) = self.cache.mmap() {
+            let data = map.as_slice();
+            let start = std::cmp::min(offset as usize, data.len());
+            let end = std::cmp::min(start + len, data.len());
+            return BlockSlice::Mapped(&data[start..end]);
+        }
+
+        let block_size = u64::from(self.cache.block_size());
+        let blk = offset / block_size;
+        let frame_offset = (offset % block_size) as usize;
+
+        if (frame_offset + len) as u64 <= block_size {
+            let frame = self.cache.frame(self.device, blk);
+            let end = std::cmp::min(frame_offset + len, frame.len());
+            return BlockSlice::Frame(frame, frame_offset..end);
+        }
+
+        let mut data = Vec::with_capacity(len);
+        let mut blk = blk;
+        let mut frame_offset = frame_offset;
+        while data.len() < len {
+            let frame = self.cache.frame(self.device, blk);
+            if frame_offset >= frame.len() {
+                break;
+            }
+            let take = std::cmp::min(frame.len() - frame_offset, len - data.len());
+            data.extend_from_slice(&frame[frame_offset..frame_offset + take]);
+            blk += 1;
+            frame_offset = 0;
+        }
+
+        let len = data.len();
+        BlockSlice::Frame(data.into(), 0..len)
+    }
+}
+
+impl Read for BlockReader<'_> {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        // Reads of a block or more are file data, not metadata: bypass the
+        // frame cache and issue one pread for the whole run instead of
+        // fetching a frame per block.
+        if buf.len() >= (self.cache.block_size() as usize) && self.cache.mmap().is_none() {
+            let amt = self.device.read_at(buf, self.pos)?;
+            self.pos += amt as u64;
+            return Ok(amt);
+        }
+
+        let amt = {
+            let available = self.fill_buf()?;
+            let amt = std::cmp::min(available.len(), buf.len());
+            buf[..amt].copy_from_slice(&available[..amt]);
+            amt
+        };
+        self.consume(amt);
+        Ok(amt)
+    }
+}
+
+impl BufRead for BlockReader<'_> {
+    fn fill_buf(&mut self) -> io::Result<&[u8]> {
+        // With the device mapped, hand out a slice of the mapping directly;
+        // no frame is copied and no read syscall is issued.
+        if let Some(map) = self.cache.mmap() {
+            let data = map.as_slice();
+            let pos = std::cmp::min(self.pos as usize, data.len());
+            return Ok(&data[pos..]);
+        }
+
+        let block_size = u64::from(self.cache.block_size());
+        let blk = self.pos / block_size;
+        let offset = (self.pos % block_size) as usize;
+
+        if self.frame.is_none() || self.frame_blk != blk {
+            self.frame = Some(self.cache.frame(self.device, blk));
+            self.frame_blk = blk;
+        }
+
+        let frame = self.frame.as_ref().unwrap();
+        if offset >= frame.len() {
+            return Ok(&[]);
+        }
+
+        Ok(&frame[offset..])
+    }
+
+    fn consume(&mut self, amt: usize) {
+        self.pos += amt as u64;
+    }
+}
+
+impl Seek for BlockReader<'_> {
+    fn seek(&mut self, pos: SeekFrom) -> io::Result<u64> {
+        self.pos = match pos {
+            SeekFrom::Start(offset) => offset,
+            SeekFrom::Current(delta) => ((self.pos as i64) + delta) as u64,
+            SeekFrom::End(delta) => ((self.cache.device_size() as i64) + delta) as u64,
+        };
+
+        Ok(self.pos)
+    }
+}
@@ -0,0 +1,102 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+use std::sync::Mutex;
+use std::sync::OnceLock;
+
+// Buffers kept beyond this count are dropped instead of pooled; with one
+// reply and a handful of run buffers per in-flight request this covers the
+// worker count with room to spare.
+pub const MAX_POOLED_BUFFERS: usize = 64;
+
+// A pool of reusable byte buffers for the read path.  Reply and run buffers
+// grow to their steady-state capacity within the first few requests; after
+// that, taking one is a pop plus a memset instead of a heap allocation.
+#[derive(Debug, Default)]
+pub struct BufPool {
+    bufs: Mutex<Vec<Vec<u8>>>,
+}
+
+impl BufPool {
+    // An empty buffer, reusing a pooled allocation when one exists.
+    pub fn take(&self) -> Vec<u8> {
+        self.bufs.lock().unwrap().pop().unwrap_or_default()
+    }
+
+    // A zero-filled buffer of the given length, for use as a read target.
+    pub fn take_zeroed(&self, len: usize) -> Vec<u8> {
+        let mut buf = self.take();
+        buf.resize(len, 0);
+        buf
+    }
+
+    // Return a buffer to the pool once its contents are no longer needed.
+    pub fn put(&self, mut buf: Vec<u8>) {
+        if buf.capacity() == 0 {
+            return;
+        }
+        buf.clear();
+
+        let mut bufs = self.bufs.lock().unwrap();
+        if bufs.len() < MAX_POOLED_BUFFERS {
+            bufs.push(buf);
+        }
+    }
+}
+
+// Like the hashname memo and the stats counters, one pool serves the whole
+// process so the backend threads and the workers share it.
+pub fn pool() -> &'static BufPool {
+    static POOL: OnceLock<BufPool> = OnceLock::new();
+    POOL.get_or_init(BufPool::default)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn pool_reuses_returned_allocations() {
+        let pool = BufPool::default();
+
+        let mut buf = pool.take_zeroed(4096);
+        assert_eq!(buf.len(), 4096);
+        assert!(buf.iter().all(|b| *b == 0));
+
+        buf[0] = 0xff;
+        let capacity = buf.capacity();
+        let ptr = buf.as_ptr();
+        pool.put(buf);
+
+        // The same allocation comes back, cleared and re-zeroed.
+        let buf = pool.take_zeroed(512);
+        assert_eq!(buf.as_ptr(), ptr);
+        assert!(buf.capacity() >= capacity);
+        assert_eq!(buf.len(), 512);
+        assert_eq!(buf[0], 0);
+    }
+}
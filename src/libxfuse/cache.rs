@@ -0,0 +1,140 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+use std::collections::{HashMap, VecDeque};
+use std::hash::Hash;
+
+// A bounded least-recently-used map.  Values are handed out by clone, so
+// callers typically store them behind an Arc.  Recency is tracked with
+// sequence numbers instead of a linked list: every access pushes a fresh
+// (key, seq) pair onto the queue and eviction skips entries whose sequence
+// number is stale.
+#[derive(Debug)]
+pub struct Lru<K: Eq + Hash + Clone, V: Clone> {
+    capacity: usize,
+    map: HashMap<K, (V, u64)>,
+    queue: VecDeque<(K, u64)>,
+    seq: u64,
+}
+
+impl<K: Eq + Hash + Clone, V: Clone> Lru<K, V> {
+    pub fn new(capacity: usize) -> Lru<K, V> {
+        Lru {
+            capacity,
+            map: HashMap::with_capacity(capacity),
+            queue: VecDeque::with_capacity(capacity),
+            seq: 0,
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.map.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.map.is_empty()
+    }
+
+    pub fn get(&mut self, key: &K) -> Option<V> {
+        self.seq += 1;
+        let seq = self.seq;
+
+        match self.map.get_mut(key) {
+            Some((value, stamp)) => {
+                *stamp = seq;
+                let value = value.clone();
+                self.queue.push_back((key.clone(), seq));
+                self.compact();
+                Some(value)
+            }
+            None => None,
+        }
+    }
+
+    pub fn insert(&mut self, key: K, value: V) {
+        if self.capacity == 0 {
+            return;
+        }
+
+        self.seq += 1;
+        let seq = self.seq;
+
+        self.map.insert(key.clone(), (value, seq));
+        self.queue.push_back((key, seq));
+
+        while self.map.len() > self.capacity {
+            match self.queue.pop_front() {
+                Some((key, seq)) => {
+                    if let Some((_, stamp)) = self.map.get(&key) {
+                        if *stamp == seq {
+                            self.map.remove(&key);
+                        }
+                    }
+                }
+                None => break,
+            }
+        }
+
+        self.compact();
+    }
+
+    pub fn remove(&mut self, key: &K) -> Option<V> {
+        self.map.remove(key).map(|(value, _)| value)
+    }
+
+    // Drop stale queue entries so the queue stays proportional to the
+    // capacity rather than to the total number of accesses.
+    fn compact(&mut self) {
+        if self.queue.len() > self.capacity.saturating_mul(8) {
+            let map = &self.map;
+            self.queue
+                .retain(|(key, seq)| map.get(key).map_or(false, |(_, stamp)| stamp == seq));
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::Lru;
+
+    #[test]
+    fn lru_evicts_least_recently_used() {
+        let mut lru: Lru<u64, u64> = Lru::new(2);
+
+        lru.insert(1, 10);
+        lru.insert(2, 20);
+
+        assert_eq!(lru.get(&1), Some(10));
+
+        lru.insert(3, 30);
+
+        assert_eq!(lru.get(&1), Some(10));
+        assert_eq!(lru.get(&2), None);
+        assert_eq!(lru.get(&3), Some(30));
+        assert_eq!(lru.len(), 2);
+    }
+}
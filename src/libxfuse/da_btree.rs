@@ -28,9 +28,10 @@
 use std::{
     cmp::Ordering,
     io::{BufRead, Seek, SeekFrom},
+    sync::{Mutex, OnceLock},
 };
 
-use super::{definitions::*, sb::Sb};
+use super::{cache::Lru, definitions::*, sb::Sb};
 
 use byteorder::{BigEndian, ReadBytesExt};
 use uuid::Uuid;
@@ -41,18 +42,67 @@ macro_rules! rol32 {
     };
 }
 
+// Fold four bytes the way one scalar hashname round does.
+macro_rules! group32 {
+    ($name:expr, $i:expr) => {
+        (($name[$i] as u32) << 21)
+            ^ (($name[$i + 1] as u32) << 14)
+            ^ (($name[$i + 2] as u32) << 7)
+            ^ ($name[$i + 3] as u32)
+    };
+}
+
+// Names long enough to be worth remembering in the hash memo; short names
+// hash in a few cycles anyway.
+const HASH_MEMO_MIN_LEN: usize = 16;
+const HASH_MEMO_SIZE: usize = 4096;
+
+fn hash_memo() -> &'static Mutex<Lru<String, XfsDahash>> {
+    static MEMO: OnceLock<Mutex<Lru<String, XfsDahash>>> = OnceLock::new();
+    MEMO.get_or_init(|| Mutex::new(Lru::new(HASH_MEMO_SIZE)))
+}
+
 pub fn hashname(name: &str) -> XfsDahash {
+    // The same generated file names get resolved over and over; remember
+    // their hashes so repeated lookups skip hashing entirely.
+    if name.len() >= HASH_MEMO_MIN_LEN {
+        let key = name.to_string();
+        if let Some(hash) = hash_memo().lock().unwrap().get(&key) {
+            return hash;
+        }
+
+        let hash = hashname_uncached(name);
+        hash_memo().lock().unwrap().insert(key, hash);
+        return hash;
+    }
+
+    hashname_uncached(name)
+}
+
+fn hashname_uncached(name: &str) -> XfsDahash {
     let name = name.as_bytes();
     let mut namelen = name.len();
     let mut hash: XfsDahash = 0;
 
     let mut i: usize = 0;
+
+    // Four scalar rounds composed into one: each round rotates the running
+    // hash by 28, so over 16 bytes the groups land at rotations 20, 24 and
+    // 28 and the hash itself at 16.  This keeps four independent xor chains
+    // in flight instead of one serial byte ladder.
+    while namelen >= 16 {
+        hash = rol32!(hash, 16)
+            ^ rol32!(group32!(name, i), 20)
+            ^ rol32!(group32!(name, i + 4), 24)
+            ^ rol32!(group32!(name, i + 8), 28)
+            ^ group32!(name, i + 12);
+
+        namelen -= 16;
+        i += 16;
+    }
+
     while namelen >= 4 {
-        hash = ((name[i] as u32) << 21)
-            ^ ((name[i + 1] as u32) << 14)
-            ^ ((name[i + 2] as u32) << 7)
-            ^ (name[i + 3] as u32)
-            ^ rol32!(hash, 7 * 4);
+        hash = group32!(name, i) ^ rol32!(hash, 7 * 4);
 
         namelen -= 4;
         i += 4;
@@ -250,3 +300,47 @@ impl XfsDa3Intnode {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    // The original one-round-per-four-bytes ladder, kept as the reference
+    // for the composed sixteen byte rounds.
+    fn hashname_scalar(name: &str) -> XfsDahash {
+        let name = name.as_bytes();
+        let mut namelen = name.len();
+        let mut hash: XfsDahash = 0;
+
+        let mut i: usize = 0;
+        while namelen >= 4 {
+            hash = group32!(name, i) ^ rol32!(hash, 7 * 4);
+
+            namelen -= 4;
+            i += 4;
+        }
+
+        match namelen {
+            3 => {
+                ((name[i] as u32) << 14)
+                    ^ ((name[i + 1] as u32) << 7)
+                    ^ (name[i + 2] as u32)
+                    ^ rol32!(hash, 7 * 3)
+            }
+            2 => ((name[i] as u32) << 7) ^ (name[i + 1] as u32) ^ rol32!(hash, 7 * 2),
+            1 => (name[i] as u32) ^ rol32!(hash, 7),
+            _ => hash,
+        }
+    }
+
+    #[test]
+    fn unrolled_hashname_matches_scalar() {
+        let long: String = (0..255u32).map(|i| (b'a' + (i % 26) as u8) as char).collect();
+
+        for len in 0..long.len() {
+            let name = &long[..len];
+            assert_eq!(hashname_uncached(name), hashname_scalar(name), "len {}", len);
+            assert_eq!(hashname(name), hashname_scalar(name), "len {}", len);
+        }
+    }
+}
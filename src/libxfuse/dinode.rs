@@ -26,7 +26,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 use std::ffi::CString;
-use std::io::{BufRead, Seek, SeekFrom};
+use std::io::{BufRead, Read, Seek, SeekFrom};
 
 use super::attr::Attr;
 use super::attr_bptree::AttrBtree;
@@ -34,6 +34,7 @@ use super::attr_leaf::AttrLeaf;
 use super::attr_shortform::AttrShortform;
 use super::bmbt_rec::BmbtRec;
 use super::btree::{BmbtKey, BmdrBlock, Btree, XfsBmbtPtr};
+use super::buf_cache::BlockReader;
 use super::definitions::*;
 use super::dinode_core::{DinodeCore, XfsDinodeFmt};
 use super::dir3::Dir3;
@@ -82,6 +83,18 @@ impl Dinode {
         superblock: &Sb,
         inode_number: XfsIno,
     ) -> Dinode {
+        Dinode::try_from(buf_reader, superblock, inode_number)
+            .expect("Inode format not yet supported.")
+    }
+
+    // A guarded decode for speculative cluster loading: a free slot, a bad
+    // magic number, or an unsupported format yields None instead of a
+    // panic.
+    pub fn try_from<R: BufRead + Seek>(
+        buf_reader: &mut R,
+        superblock: &Sb,
+        inode_number: XfsIno,
+    ) -> Option<Dinode> {
         let ag_no: XfsAgnumber =
             (inode_number >> (superblock.sb_agblklog + superblock.sb_inopblog)) as u32;
         if ag_no >= superblock.sb_agcount {
@@ -97,7 +110,11 @@ impl Dinode {
         let off = off + blk_ino * (superblock.sb_inodesize as u32);
 
         buf_reader.seek(SeekFrom::Start(off as u64)).unwrap();
-        let di_core = DinodeCore::from(buf_reader);
+        let di_core = DinodeCore::try_from(buf_reader)?;
+        if di_core.di_mode == 0 {
+            // A freed slot in the cluster.
+            return None;
+        }
 
         let di_u: Option<DiU>;
         match (di_core.di_mode as mode_t) & S_IFMT {
@@ -125,9 +142,7 @@ impl Dinode {
 
                     di_u = Some(DiU::Bmbt((bmbt, keys, pointers)));
                 }
-                _ => {
-                    panic!("Directory format not yet supported.");
-                }
+                _ => return None,
             },
             S_IFDIR => match di_core.di_format {
                 XfsDinodeFmt::Local => {
@@ -157,9 +172,7 @@ impl Dinode {
 
                     di_u = Some(DiU::Bmbt((bmbt, keys, pointers)));
                 }
-                _ => {
-                    panic!("Directory format not yet supported.");
-                }
+                _ => return None,
             },
             S_IFLNK => match di_core.di_format {
                 XfsDinodeFmt::Local => {
@@ -177,11 +190,9 @@ impl Dinode {
                     }
                     di_u = Some(DiU::Bmx(bmx));
                 }
-                _ => {
-                    panic!("Unexpected format for symlink");
-                }
+                _ => return None,
             },
-            _ => panic!("Inode type not yet supported."),
+            _ => return None,
         }
 
         buf_reader.seek(SeekFrom::Start(off as u64)).unwrap();
@@ -221,26 +232,20 @@ impl Dinode {
 
                     di_a = Some(DiA::Abmbt((bmbt, keys, pointers)));
                 }
-                _ => {
-                    panic!("Attributes format not yet supported.");
-                }
+                _ => return None,
             }
         } else {
             di_a = None;
         }
 
-        Dinode {
+        Some(Dinode {
             di_core,
             di_u: di_u.unwrap(),
             di_a,
-        }
+        })
     }
 
-    pub fn get_dir<R: BufRead + Seek>(
-        &self,
-        buf_reader: &mut R,
-        superblock: &Sb,
-    ) -> Box<dyn Dir3<R>> {
+    pub fn get_dir(&self, buf_reader: &mut BlockReader<'_>, superblock: &Sb) -> Box<dyn Dir3> {
         match &self.di_u {
             DiU::Dir2Sf(dir) => Box::new(dir.clone()),
             DiU::Bmx(bmx) => {
@@ -268,23 +273,16 @@ impl Dinode {
         }
     }
 
-    pub fn get_file<R: BufRead + Seek>(
-        &self,
-        _buf_reader: &mut R,
-        superblock: &Sb,
-    ) -> Box<dyn File<R>> {
+    pub fn get_file(&self, _buf_reader: &mut BlockReader<'_>, superblock: &Sb) -> Box<dyn File> {
         match &self.di_u {
             DiU::Bmx(bmx) => Box::new(FileExtentList {
                 bmx: bmx.clone(),
                 size: self.di_core.di_size,
                 block_size: superblock.sb_blocksize,
+                hint: 0,
             }),
             DiU::Bmbt((bmdr, keys, pointers)) => Box::new(FileBtree {
-                btree: Btree {
-                    bmdr: bmdr.clone(),
-                    keys: keys.clone(),
-                    ptrs: pointers.clone(),
-                },
+                btree: Btree::new(bmdr.clone(), keys.clone(), pointers.clone()),
                 size: self.di_core.di_size,
                 block_size: superblock.sb_blocksize,
             }),
@@ -339,11 +337,7 @@ impl Dinode {
                 }
             }
             Some(DiA::Abmbt((bmdr, keys, pointers))) => Some(Box::new(AttrBtree {
-                btree: Btree {
-                    bmdr: bmdr.clone(),
-                    keys: keys.clone(),
-                    ptrs: pointers.clone(),
-                },
+                btree: Btree::new(bmdr.clone(), keys.clone(), pointers.clone()),
                 total_size: -1,
             })),
             None => None,
@@ -109,14 +109,20 @@ pub struct DinodeCore {
 
 impl DinodeCore {
     pub fn from<R: BufRead>(buf_reader: &mut R) -> DinodeCore {
+        DinodeCore::try_from(buf_reader).expect("Agi magic number is invalid")
+    }
+
+    // A guarded parse for speculative decoding: a bad magic number or an
+    // unrecognized format yields None instead of a panic.
+    pub fn try_from<R: BufRead>(buf_reader: &mut R) -> Option<DinodeCore> {
         let di_magic = buf_reader.read_u16::<BigEndian>().unwrap();
         if di_magic != XFS_DINODE_MAGIC {
-            panic!("Agi magic number is invalid");
+            return None;
         }
 
         let di_mode = buf_reader.read_u16::<BigEndian>().unwrap();
         let di_version = buf_reader.read_i8().unwrap();
-        let di_format = XfsDinodeFmt::from_u8(buf_reader.read_u8().unwrap()).unwrap();
+        let di_format = XfsDinodeFmt::from_u8(buf_reader.read_u8().unwrap())?;
         let di_onlink = buf_reader.read_u16::<BigEndian>().unwrap();
         let di_uid = buf_reader.read_u32::<BigEndian>().unwrap();
         let di_gid = buf_reader.read_u32::<BigEndian>().unwrap();
@@ -149,7 +155,7 @@ impl DinodeCore {
         let di_nextents = buf_reader.read_i32::<BigEndian>().unwrap();
         let di_anextents = buf_reader.read_i16::<BigEndian>().unwrap();
         let di_forkoff = buf_reader.read_u8().unwrap();
-        let di_aformat = XfsDinodeFmt::from_u8(buf_reader.read_u8().unwrap()).unwrap();
+        let di_aformat = XfsDinodeFmt::from_u8(buf_reader.read_u8().unwrap())?;
         let di_dmevmask = buf_reader.read_u32::<BigEndian>().unwrap();
         let di_dmstate = buf_reader.read_u16::<BigEndian>().unwrap();
         let di_flags = buf_reader.read_u16::<BigEndian>().unwrap();
@@ -174,7 +180,7 @@ impl DinodeCore {
         let di_ino = buf_reader.read_u64::<BigEndian>().unwrap();
         let di_uuid = Uuid::from_u128(buf_reader.read_u128::<BigEndian>().unwrap());
 
-        DinodeCore {
+        Some(DinodeCore {
             di_magic,
             di_mode,
             di_version,
@@ -211,6 +217,6 @@ impl DinodeCore {
             di_crtime,
             di_ino,
             di_uuid,
-        }
+        })
     }
 }
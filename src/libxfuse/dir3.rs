@@ -25,17 +25,17 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-use std::cmp::Ordering;
 use std::io::{BufRead, Seek, SeekFrom};
 use std::mem;
 
+use super::buf_cache::BlockReader;
 use super::da_btree::XfsDa3Blkinfo;
 use super::definitions::*;
 use super::sb::Sb;
 
 use byteorder::{BigEndian, ReadBytesExt};
 use fuser::{FileAttr, FileType};
-use libc::{c_int, ENOENT};
+use libc::c_int;
 use uuid::Uuid;
 
 pub type XfsDir2DataOff = u16;
@@ -297,27 +297,25 @@ impl Dir2LeafNDisk {
         Dir2LeafNDisk { hdr, ents }
     }
 
-    pub fn get_address(&self, hash: XfsDahash) -> Result<XfsDir2Dataptr, c_int> {
-        let mut low: i64 = 0;
-        let mut high: i64 = (self.ents.len() - 1) as i64;
+    // All entries whose hash matches, in leaf order.  Entries are sorted
+    // by hash, so binary search to the first match and take the run of
+    // duplicates; the caller verifies names, since distinct names can
+    // share a hash.
+    pub fn get_addresses(&self, hash: XfsDahash) -> &[Dir2LeafEntry] {
+        let first = self.ents.partition_point(|entry| entry.hashval < hash);
 
-        while low <= high {
-            let mid = low + ((high - low) / 2);
-
-            let entry = &self.ents[mid as usize];
-
-            match entry.hashval.cmp(&hash) {
-                Ordering::Greater => {
-                    high = mid - 1;
-                }
-                Ordering::Less => {
-                    low = mid + 1;
-                }
-                Ordering::Equal => return Ok(entry.address),
-            }
+        let mut last = first;
+        while last < self.ents.len() && self.ents[last].hashval == hash {
+            last += 1;
         }
 
-        Err(ENOENT)
+        &self.ents[first..last]
+    }
+
+    // Whether a duplicate-hash run reaches the end of this leaf; if so the
+    // run may continue in the forward sibling.
+    pub fn run_reaches_end(&self, hash: XfsDahash) -> bool {
+        self.ents.last().map(|entry| entry.hashval) == Some(hash)
     }
 }
 
@@ -372,42 +370,46 @@ impl Dir2LeafDisk {
         }
     }
 
-    pub fn get_address(&self, hash: XfsDahash) -> Result<XfsDir2Dataptr, c_int> {
-        let mut low: i64 = 0;
-        let mut high: i64 = (self.ents.len() - 1) as i64;
-
-        while low <= high {
-            let mid = low + ((high - low) / 2);
+    // As for Dir2LeafNDisk: the run of entries matching the hash, for the
+    // caller to verify by name.  A leaf-format directory has exactly one
+    // leaf block, so the run can never continue elsewhere.
+    pub fn get_addresses(&self, hash: XfsDahash) -> &[Dir2LeafEntry] {
+        let first = self.ents.partition_point(|entry| entry.hashval < hash);
 
-            let entry = &self.ents[mid as usize];
-
-            match entry.hashval.cmp(&hash) {
-                Ordering::Greater => {
-                    high = mid - 1;
-                }
-                Ordering::Less => {
-                    low = mid + 1;
-                }
-                Ordering::Equal => return Ok(entry.address),
-            }
+        let mut last = first;
+        while last < self.ents.len() && self.ents[last].hashval == hash {
+            last += 1;
         }
 
-        Err(ENOENT)
+        &self.ents[first..last]
     }
 }
 
-pub trait Dir3<R: BufRead + Seek> {
+// The trait is object safe (and Send) so a parsed directory can live in the
+// open-handle table as a cursor and be resumed across readdir batches.
+pub trait Dir3: std::fmt::Debug + Send {
     fn lookup(
         &self,
-        buf_reader: &mut R,
+        buf_reader: &mut BlockReader<'_>,
         super_block: &Sb,
         name: &str,
     ) -> Result<(FileAttr, u64), c_int>;
 
     fn next(
-        &self,
-        buf_reader: &mut R,
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
         super_block: &Sb,
         offset: i64,
     ) -> Result<(XfsIno, i64, FileType, String), c_int>;
+
+    // Filesystem blocks holding the directory's entry data, for the
+    // readdir prefetcher; formats that parse their data up front return
+    // none.
+    fn data_fsblocks(
+        &mut self,
+        _buf_reader: &mut BlockReader<'_>,
+        _super_block: &Sb,
+    ) -> Vec<XfsFsblock> {
+        Vec::new()
+    }
 }
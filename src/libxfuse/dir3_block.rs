@@ -26,22 +26,21 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 use std::collections::HashMap;
-use std::io::{BufRead, Seek, SeekFrom};
+use std::io::{BufRead, Read, Seek, SeekFrom};
 use std::mem;
-use std::time::{Duration, UNIX_EPOCH};
 
+use super::buf_cache::BlockReader;
 use super::da_btree::hashname;
 use super::definitions::*;
 use super::dinode::Dinode;
-use super::dir3::{
-    Dir2DataEntry, Dir2DataUnused, Dir2LeafEntry, Dir3, Dir3DataHdr, XfsDir2Dataptr,
-};
+use super::dir3::{Dir2DataEntry, Dir2LeafEntry, Dir3, Dir3DataHdr, XfsDir2Dataptr};
 use super::sb::Sb;
-use super::utils::{get_file_type, FileKind};
+use super::utils::{get_file_attrs, get_file_type, FileKind};
+use super::view::Dir2DataEntryIter;
 
 use byteorder::{BigEndian, ReadBytesExt};
 use fuser::{FileAttr, FileType};
-use libc::{c_int, ENOENT, S_IFMT};
+use libc::{c_int, ENOENT};
 
 pub const XFS_DIR2_DATA_FD_COUNT: usize = 3;
 
@@ -137,10 +136,10 @@ impl Dir2Block {
     }
 }
 
-impl<R: BufRead + Seek> Dir3<R> for Dir2Block {
+impl Dir3 for Dir2Block {
     fn lookup(
         &self,
-        buf_reader: &mut R,
+        buf_reader: &mut BlockReader<'_>,
         super_block: &Sb,
         name: &str,
     ) -> Result<(FileAttr, u64), c_int> {
@@ -155,34 +154,7 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Block {
 
             let dinode = Dinode::from(buf_reader.by_ref(), super_block, entry.inumber);
 
-            let kind = get_file_type(FileKind::Mode(dinode.di_core.di_mode))?;
-
-            let attr = FileAttr {
-                ino: entry.inumber,
-                size: dinode.di_core.di_size as u64,
-                blocks: dinode.di_core.di_nblocks,
-                atime: UNIX_EPOCH + Duration::new(
-                    dinode.di_core.di_atime.t_sec as u64,
-                    dinode.di_core.di_atime.t_nsec,
-                ),
-                mtime: UNIX_EPOCH + Duration::new(
-                    dinode.di_core.di_mtime.t_sec as u64,
-                    dinode.di_core.di_mtime.t_nsec,
-                ),
-                ctime: UNIX_EPOCH + Duration::new(
-                    dinode.di_core.di_ctime.t_sec as u64,
-                    dinode.di_core.di_ctime.t_nsec,
-                ),
-                crtime: UNIX_EPOCH,
-                kind,
-                perm: dinode.di_core.di_mode & (!(S_IFMT as u16)),
-                nlink: dinode.di_core.di_nlink,
-                uid: dinode.di_core.di_uid,
-                gid: dinode.di_core.di_gid,
-                rdev: 0,
-                blksize: 0,
-                flags: 0,
-            };
+            let attr = get_file_attrs(entry.inumber, &dinode.di_core)?;
 
             Ok((attr, dinode.di_core.di_gen.into()))
         } else {
@@ -191,41 +163,30 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Block {
     }
 
     fn next(
-        &self,
-        buf_reader: &mut R,
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
         _super_block: &Sb,
         offset: i64,
     ) -> Result<(XfsIno, i64, FileType, String), c_int> {
-        let mut next = offset == 0;
+        let next = offset == 0;
         let offset = if offset == 0 {
             mem::size_of::<Dir3DataHdr>() as i64
         } else {
             offset
         };
-        buf_reader
-            .seek(SeekFrom::Start(self.offset + (offset as u64)))
-            .unwrap();
 
-        while buf_reader.stream_position().unwrap() < self.data_end {
-            let freetag = buf_reader.read_u16::<BigEndian>().unwrap();
-            buf_reader.seek(SeekFrom::Current(-2)).unwrap();
+        let data = buf_reader.block(self.offset, (self.data_end - self.offset) as usize);
+        let mut entries = Dir2DataEntryIter::new(&data, offset as usize);
 
-            if freetag == 0xffff {
-                Dir2DataUnused::from(buf_reader.by_ref());
-            } else if next {
-                let entry = Dir2DataEntry::from(buf_reader.by_ref());
-
-                let kind = get_file_type(FileKind::Type(entry.ftype))?;
-
-                let name = entry.name;
+        if !next {
+            // The cursor points at the entry returned last time; skip it.
+            entries.next();
+        }
 
-                return Ok((entry.inumber, entry.tag.into(), kind, name));
-            } else {
-                let length = Dir2DataEntry::get_length(buf_reader.by_ref());
-                buf_reader.seek(SeekFrom::Current(length)).unwrap();
+        if let Some(entry) = entries.next() {
+            let kind = get_file_type(FileKind::Type(entry.ftype()))?;
 
-                next = true;
-            }
+            return Ok((entry.inumber(), entry.tag().into(), kind, entry.name()));
         }
 
         Err(ENOENT)
@@ -26,22 +26,22 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 use std::cmp::Ordering;
-use std::io::{BufRead, Seek, SeekFrom};
+use std::io::{BufRead, Read, Seek, SeekFrom};
 use std::mem;
-use std::time::{Duration, UNIX_EPOCH};
 
 use super::bmbt_rec::BmbtRec;
-use super::btree::{BmbtKey, BmdrBlock, XfsBmbtBlock, XfsBmbtPtr};
+use super::btree::{BmbtKey, BmdrBlock, Btree, XfsBmbtBlock, XfsBmbtPtr};
+use super::buf_cache::BlockReader;
 use super::da_btree::{hashname, XfsDa3NodeEntry, XfsDa3NodeHdr};
 use super::definitions::*;
 use super::dinode::Dinode;
-use super::dir3::{Dir2DataEntry, Dir2DataUnused, Dir2LeafEntry, Dir3, Dir3DataHdr, Dir3LeafHdr};
+use super::dir3::{Dir2DataEntry, Dir2DataUnused, Dir2LeafNDisk, Dir3, Dir3DataHdr};
 use super::sb::Sb;
-use super::utils::{get_file_type, FileKind};
+use super::utils::{get_file_attrs, get_file_type, FileKind};
 
 use byteorder::{BigEndian, ReadBytesExt};
 use fuser::{FileAttr, FileType};
-use libc::{c_int, ENOENT, S_IFMT};
+use libc::{c_int, ENOENT};
 
 #[derive(Debug)]
 pub struct Dir2Btree {
@@ -184,10 +184,10 @@ impl Dir2Btree {
     }
 }
 
-impl<R: BufRead + Seek> Dir3<R> for Dir2Btree {
+impl Dir3 for Dir2Btree {
     fn lookup(
         &self,
-        buf_reader: &mut R,
+        buf_reader: &mut BlockReader<'_>,
         super_block: &Sb,
         name: &str,
     ) -> Result<(FileAttr, u64), c_int> {
@@ -237,73 +237,93 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Btree {
             return Err(ENOENT);
         }
 
-        let hdr = Dir3LeafHdr::from(buf_reader.by_ref(), super_block);
-
-        for _i in 0..hdr.count {
-            let entry = Dir2LeafEntry::from(buf_reader.by_ref());
+        let mut leaf = Dir2LeafNDisk::from(buf_reader.by_ref(), super_block);
 
-            if entry.hashval == hash {
-                let address = (entry.address as u64) * 8;
+        loop {
+            // Distinct names can share a hash: verify each candidate of
+            // the duplicate run by name.
+            for leaf_entry in leaf.get_addresses(hash) {
+                let address = (leaf_entry.address as u64) * 8;
                 let idx = (address / (self.block_size as u64)) as usize;
                 let address = address % (self.block_size as u64);
 
                 let (_, bmbt_rec) = self.map_dblock(buf_reader.by_ref(), super_block, idx as u32);
 
-                if let Some(bmbt_rec_some) = &bmbt_rec {
-                    buf_reader
-                        .seek(SeekFrom::Start(
-                            (bmbt_rec_some.br_startblock) * (self.block_size as u64),
-                        ))
-                        .unwrap();
-
-                    buf_reader.seek(SeekFrom::Current(address as i64)).unwrap();
-
-                    let entry = Dir2DataEntry::from(buf_reader.by_ref());
-
-                    let dinode = Dinode::from(buf_reader.by_ref(), super_block, entry.inumber);
-
-                    let kind = get_file_type(FileKind::Mode(dinode.di_core.di_mode))?;
-
-                    let attr = FileAttr {
-                        ino: entry.inumber,
-                        size: dinode.di_core.di_size as u64,
-                        blocks: dinode.di_core.di_nblocks,
-                        atime: UNIX_EPOCH + Duration::new(
-                            dinode.di_core.di_atime.t_sec as u64,
-                            dinode.di_core.di_atime.t_nsec,
-                        ),
-                        mtime: UNIX_EPOCH + Duration::new(
-                            dinode.di_core.di_mtime.t_sec as u64,
-                            dinode.di_core.di_mtime.t_nsec
-                        ),
-                        ctime: UNIX_EPOCH + Duration::new(
-                            dinode.di_core.di_ctime.t_sec as u64,
-                            dinode.di_core.di_ctime.t_nsec
-                        ),
-                        crtime: UNIX_EPOCH,
-                        kind,
-                        perm: dinode.di_core.di_mode & (!(S_IFMT as u16)),
-                        nlink: dinode.di_core.di_nlink,
-                        uid: dinode.di_core.di_uid,
-                        gid: dinode.di_core.di_gid,
-                        rdev: 0,
-                        blksize: 0,
-                        flags: 0,
-                    };
-
-                    return Ok((attr, dinode.di_core.di_gen.into()));
-                } else {
-                    return Err(ENOENT);
+                let bmbt_rec_some = match &bmbt_rec {
+                    Some(bmbt_rec_some) => bmbt_rec_some,
+                    None => return Err(ENOENT),
                 };
+
+                buf_reader
+                    .seek(SeekFrom::Start(
+                        (bmbt_rec_some.br_startblock) * (self.block_size as u64),
+                    ))
+                    .unwrap();
+
+                buf_reader.seek(SeekFrom::Current(address as i64)).unwrap();
+
+                let entry = Dir2DataEntry::from(buf_reader.by_ref());
+
+                if entry.name != name {
+                    continue;
+                }
+
+                let dinode = Dinode::from(buf_reader.by_ref(), super_block, entry.inumber);
+
+                let attr = get_file_attrs(entry.inumber, &dinode.di_core)?;
+
+                return Ok((attr, dinode.di_core.di_gen.into()));
             }
+
+            // A run ending at the last entry may continue in the forward
+            // sibling leaf.
+            if !leaf.run_reaches_end(hash) || leaf.hdr.info.forw == 0 {
+                return Err(ENOENT);
+            }
+
+            let (_, bmbt_rec) =
+                self.map_dblock(buf_reader.by_ref(), super_block, leaf.hdr.info.forw);
+            let bmbt_rec_some = match &bmbt_rec {
+                Some(bmbt_rec_some) => bmbt_rec_some,
+                None => return Err(ENOENT),
+            };
+
+            buf_reader
+                .seek(SeekFrom::Start(
+                    (bmbt_rec_some.br_startblock) * (self.block_size as u64),
+                ))
+                .unwrap();
+            leaf = Dir2LeafNDisk::from(buf_reader.by_ref(), super_block);
         }
+    }
 
-        Err(ENOENT)
+    fn data_fsblocks(
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
+        super_block: &Sb,
+    ) -> Vec<XfsFsblock> {
+        let leaf_dblock = super_block.get_dir3_leaf_offset();
+
+        let btree = Btree::new(self.bmbt.clone(), self.keys.clone(), self.pointers.clone());
+        let mut extents = btree.extent_iter(buf_reader.by_ref(), super_block, 0);
+
+        let mut blocks = Vec::new();
+        while let Some(record) = extents.next_record(buf_reader.by_ref(), super_block) {
+            if record.br_startoff >= leaf_dblock {
+                break;
+            }
+            let count = std::cmp::min(record.br_blockcount, leaf_dblock - record.br_startoff);
+            for idx in 0..count {
+                blocks.push(record.br_startblock + idx);
+            }
+        }
+
+        blocks
     }
 
     fn next(
-        &self,
-        buf_reader: &mut R,
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
         super_block: &Sb,
         offset: i64,
     ) -> Result<(XfsIno, i64, FileType, String), c_int> {
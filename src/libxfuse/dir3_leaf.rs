@@ -25,21 +25,21 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-use std::io::{BufRead, Seek, SeekFrom};
+use std::io::{BufRead, Read, Seek, SeekFrom};
 use std::mem;
-use std::time::{Duration, UNIX_EPOCH};
 
 use super::bmbt_rec::BmbtRec;
+use super::buf_cache::BlockReader;
 use super::da_btree::hashname;
 use super::definitions::*;
 use super::dinode::Dinode;
-use super::dir3::{Dir2Data, Dir2DataEntry, Dir2DataUnused, Dir2LeafDisk, Dir3, Dir3DataHdr};
+use super::dir3::{Dir2Data, Dir2DataEntry, Dir2LeafDisk, Dir3, Dir3DataHdr};
 use super::sb::Sb;
-use super::utils::{get_file_type, FileKind};
+use super::utils::{get_file_attrs, get_file_type, FileKind};
+use super::view::Dir2DataEntryIter;
 
-use byteorder::{BigEndian, ReadBytesExt};
 use fuser::{FileAttr, FileType};
-use libc::{c_int, ENOENT, S_IFMT};
+use libc::{c_int, ENOENT};
 
 #[derive(Debug)]
 pub struct Dir2Leaf {
@@ -74,66 +74,70 @@ impl Dir2Leaf {
     }
 }
 
-impl<R: BufRead + Seek> Dir3<R> for Dir2Leaf {
+impl Dir3 for Dir2Leaf {
     fn lookup(
         &self,
-        buf_reader: &mut R,
+        buf_reader: &mut BlockReader<'_>,
         super_block: &Sb,
         name: &str,
     ) -> Result<(FileAttr, u64), c_int> {
         let hash = hashname(name);
 
-        let address = self.leaf.get_address(hash)? * 8;
-        let idx = (address / self.entry_size) as usize;
-        let address = address % self.entry_size;
+        // Distinct names can share a hash: verify each candidate of the
+        // duplicate run by name.
+        for leaf_entry in self.leaf.get_addresses(hash) {
+            let address = leaf_entry.address * 8;
+            let idx = (address / self.entry_size) as usize;
+            let address = address % self.entry_size;
 
-        if idx >= self.entries.len() {
-            return Err(ENOENT);
+            if idx >= self.entries.len() {
+                continue;
+            }
+            let entry: &Dir2Data = &self.entries[idx];
+
+            buf_reader
+                .seek(SeekFrom::Start(entry.offset + (address as u64)))
+                .unwrap();
+            let entry = Dir2DataEntry::from(buf_reader.by_ref());
+
+            if entry.name != name {
+                continue;
+            }
+
+            let dinode = Dinode::from(buf_reader.by_ref(), super_block, entry.inumber);
+
+            let attr = get_file_attrs(entry.inumber, &dinode.di_core)?;
+
+            return Ok((attr, dinode.di_core.di_gen.into()));
         }
-        let entry: &Dir2Data = &self.entries[idx];
-
-        buf_reader
-            .seek(SeekFrom::Start(entry.offset + (address as u64)))
-            .unwrap();
-        let entry = Dir2DataEntry::from(buf_reader.by_ref());
-
-        let dinode = Dinode::from(buf_reader.by_ref(), super_block, entry.inumber);
-
-        let kind = get_file_type(FileKind::Mode(dinode.di_core.di_mode))?;
-
-        let attr = FileAttr {
-            ino: entry.inumber,
-            size: dinode.di_core.di_size as u64,
-            blocks: dinode.di_core.di_nblocks,
-            atime: UNIX_EPOCH + Duration::new(
-                dinode.di_core.di_atime.t_sec as u64,
-                dinode.di_core.di_atime.t_nsec,
-            ),
-            mtime: UNIX_EPOCH + Duration::new(
-                dinode.di_core.di_mtime.t_sec as u64,
-                dinode.di_core.di_mtime.t_nsec,
-            ),
-            ctime: UNIX_EPOCH + Duration::new(
-                dinode.di_core.di_ctime.t_sec as u64,
-                dinode.di_core.di_ctime.t_nsec,
-            ),
-            crtime: UNIX_EPOCH,
-            kind,
-            perm: dinode.di_core.di_mode & (!(S_IFMT as u16)),
-            nlink: dinode.di_core.di_nlink,
-            uid: dinode.di_core.di_uid,
-            gid: dinode.di_core.di_gid,
-            rdev: 0,
-            blksize: 0,
-            flags: 0,
-        };
 
-        Ok((attr, dinode.di_core.di_gen.into()))
+        Err(ENOENT)
+    }
+
+    fn data_fsblocks(
+        &mut self,
+        _buf_reader: &mut BlockReader<'_>,
+        super_block: &Sb,
+    ) -> Vec<XfsFsblock> {
+        // Each parsed data entry starts one directory block whose device
+        // offset was recorded at parse time.
+        let frames = 1u64 << super_block.sb_dirblklog;
+        let block_size = u64::from(super_block.sb_blocksize);
+
+        let mut blocks = Vec::with_capacity(self.entries.len() * frames as usize);
+        for entry in self.entries.iter() {
+            let first = entry.offset / block_size;
+            for idx in 0..frames {
+                blocks.push(first + idx);
+            }
+        }
+
+        blocks
     }
 
     fn next(
-        &self,
-        buf_reader: &mut R,
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
         _super_block: &Sb,
         offset: i64,
     ) -> Result<(XfsIno, i64, FileType, String), c_int> {
@@ -142,7 +146,7 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Leaf {
         let offset = offset & ((1 << (64 - 8)) - 1);
 
         let mut next = offset == 0;
-        let offset = if offset == 0 {
+        let mut offset = if offset == 0 {
             mem::size_of::<Dir3DataHdr>() as u64
         } else {
             offset
@@ -153,33 +157,22 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Leaf {
         }
         let mut entry: &Dir2Data = &self.entries[idx];
 
-        buf_reader
-            .seek(SeekFrom::Start(entry.offset + (offset as u64)))
-            .unwrap();
-
         loop {
-            while buf_reader.stream_position().unwrap() < (entry.offset + (self.entry_size as u64))
-            {
-                let freetag = buf_reader.read_u16::<BigEndian>().unwrap();
-                buf_reader.seek(SeekFrom::Current(-2)).unwrap();
-
-                if freetag == 0xffff {
-                    Dir2DataUnused::from(buf_reader.by_ref());
-                } else if next {
-                    let entry = Dir2DataEntry::from(buf_reader.by_ref());
+            let data = buf_reader.block(entry.offset, self.entry_size as usize);
+            let mut entries = Dir2DataEntryIter::new(&data, offset as usize);
 
-                    let kind = get_file_type(FileKind::Type(entry.ftype))?;
-
-                    let name = entry.name;
+            if !next {
+                // The cursor points at the entry returned last time; skip it.
+                entries.next();
+                next = true;
+            }
 
-                    let tag = ((idx as u64) << (64 - 8)) | (entry.tag as u64);
+            if let Some(entry) = entries.next() {
+                let kind = get_file_type(FileKind::Type(entry.ftype()))?;
 
-                    return Ok((entry.inumber, tag as i64, kind, name));
-                } else {
-                    Dir2DataEntry::from(buf_reader.by_ref());
+                let tag = ((idx as u64) << (64 - 8)) | (entry.tag() as u64);
 
-                    next = true;
-                }
+                return Ok((entry.inumber(), tag as i64, kind, entry.name()));
             }
 
             idx += 1;
@@ -188,12 +181,7 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Leaf {
                 break;
             }
             entry = &self.entries[idx];
-
-            buf_reader
-                .seek(SeekFrom::Start(
-                    entry.offset + (mem::size_of::<Dir3DataHdr>() as u64),
-                ))
-                .unwrap();
+            offset = mem::size_of::<Dir3DataHdr>() as u64;
         }
 
         Err(ENOENT)
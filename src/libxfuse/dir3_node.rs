@@ -25,21 +25,22 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-use std::io::{BufRead, Seek, SeekFrom};
+use std::io::{BufRead, Read, Seek, SeekFrom};
 use std::mem;
-use std::time::{Duration, UNIX_EPOCH};
 
 use super::bmbt_rec::BmbtRec;
+use super::buf_cache::BlockReader;
 use super::da_btree::{hashname, XfsDa3Intnode};
 use super::definitions::*;
 use super::dinode::Dinode;
-use super::dir3::{Dir2DataEntry, Dir2DataUnused, Dir2LeafNDisk, Dir3, Dir3BlkHdr, Dir3DataHdr};
+use super::dir3::{Dir2DataEntry, Dir2LeafNDisk, Dir3, Dir3BlkHdr, Dir3DataHdr};
 use super::sb::Sb;
-use super::utils::{get_file_type, FileKind};
+use super::utils::{get_file_attrs, get_file_type, FileKind};
+use super::view::Dir2DataEntryIter;
 
 use byteorder::{BigEndian, ReadBytesExt};
 use fuser::{FileAttr, FileType};
-use libc::{c_int, ENOENT, S_IFMT};
+use libc::{c_int, ENOENT};
 
 #[derive(Debug)]
 pub struct Dir3FreeHdr {
@@ -133,10 +134,10 @@ impl Dir2Node {
     }
 }
 
-impl<R: BufRead + Seek> Dir3<R> for Dir2Node {
+impl Dir3 for Dir2Node {
     fn lookup(
         &self,
-        buf_reader: &mut R,
+        buf_reader: &mut BlockReader<'_>,
         super_block: &Sb,
         name: &str,
     ) -> Result<(FileAttr, u64), c_int> {
@@ -169,58 +170,74 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Node {
             buf_reader.seek(SeekFrom::Start(leaf_offset)).unwrap();
         }
 
-        let leaf = Dir2LeafNDisk::from(buf_reader.by_ref(), super_block);
-
-        let address = leaf.get_address(hash)? * 8;
-        let idx = (address / super_block.sb_blocksize) as usize;
-        let address = address % super_block.sb_blocksize;
-
-        let blk = self.map_dblock_number(idx as u64);
-        buf_reader
-            .seek(SeekFrom::Start(blk * u64::from(super_block.sb_blocksize)))
-            .unwrap();
-
-        buf_reader.seek(SeekFrom::Current(address as i64)).unwrap();
-
-        let entry = Dir2DataEntry::from(buf_reader.by_ref());
-
-        let dinode = Dinode::from(buf_reader.by_ref(), super_block, entry.inumber);
-
-        let kind = get_file_type(FileKind::Mode(dinode.di_core.di_mode))?;
-
-        let attr = FileAttr {
-            ino: entry.inumber,
-            size: dinode.di_core.di_size as u64,
-            blocks: dinode.di_core.di_nblocks,
-            atime: UNIX_EPOCH + Duration::new(
-                dinode.di_core.di_atime.t_sec as u64,
-                dinode.di_core.di_atime.t_nsec,
-            ),
-            mtime: UNIX_EPOCH + Duration::new(
-                dinode.di_core.di_mtime.t_sec as u64,
-                dinode.di_core.di_mtime.t_nsec,
-            ),
-            ctime: UNIX_EPOCH + Duration::new(
-                dinode.di_core.di_ctime.t_sec as u64,
-                dinode.di_core.di_ctime.t_nsec,
-            ),
-            crtime: UNIX_EPOCH,
-            kind,
-            perm: dinode.di_core.di_mode & (!(S_IFMT as u16)),
-            nlink: dinode.di_core.di_nlink,
-            uid: dinode.di_core.di_uid,
-            gid: dinode.di_core.di_gid,
-            rdev: 0,
-            blksize: 16384,
-            flags: 0,
-        };
+        let mut leaf = Dir2LeafNDisk::from(buf_reader.by_ref(), super_block);
+
+        loop {
+            // Distinct names can share a hash: verify each candidate of
+            // the duplicate run by name.
+            for leaf_entry in leaf.get_addresses(hash) {
+                let address = leaf_entry.address * 8;
+                let idx = (address / super_block.sb_blocksize) as usize;
+                let address = address % super_block.sb_blocksize;
+
+                let blk = self.map_dblock_number(idx as u64);
+                buf_reader
+                    .seek(SeekFrom::Start(blk * u64::from(super_block.sb_blocksize)))
+                    .unwrap();
+
+                buf_reader.seek(SeekFrom::Current(address as i64)).unwrap();
+
+                let entry = Dir2DataEntry::from(buf_reader.by_ref());
+
+                if entry.name != name {
+                    continue;
+                }
 
-        Ok((attr, dinode.di_core.di_gen.into()))
+                let dinode = Dinode::from(buf_reader.by_ref(), super_block, entry.inumber);
+
+                let attr = get_file_attrs(entry.inumber, &dinode.di_core)?;
+
+                return Ok((attr, dinode.di_core.di_gen.into()));
+            }
+
+            // A run ending at the last entry may continue in the forward
+            // sibling leaf.
+            if !leaf.run_reaches_end(hash) || leaf.hdr.info.forw == 0 {
+                return Err(ENOENT);
+            }
+
+            let blk = self.map_dblock_number(leaf.hdr.info.forw.into());
+            buf_reader
+                .seek(SeekFrom::Start(blk * u64::from(super_block.sb_blocksize)))
+                .unwrap();
+            leaf = Dir2LeafNDisk::from(buf_reader.by_ref(), super_block);
+        }
+    }
+
+    fn data_fsblocks(
+        &mut self,
+        _buf_reader: &mut BlockReader<'_>,
+        super_block: &Sb,
+    ) -> Vec<XfsFsblock> {
+        let leaf_dblock = super_block.get_dir3_leaf_offset();
+
+        let mut blocks = Vec::new();
+        for record in self.bmx.iter() {
+            if record.br_startoff >= leaf_dblock {
+                continue;
+            }
+            let count = std::cmp::min(record.br_blockcount, leaf_dblock - record.br_startoff);
+            for idx in 0..count {
+                blocks.push(record.br_startblock + idx);
+            }
+        }
+
+        blocks
     }
 
     fn next(
-        &self,
-        buf_reader: &mut R,
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
         _super_block: &Sb,
         offset: i64,
     ) -> Result<(XfsIno, i64, FileType, String), c_int> {
@@ -244,38 +261,26 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Node {
 
         while let Some(bmbt_rec_some) = &bmbt_rec {
             while bmbt_rec_idx < bmbt_rec_some.br_blockcount {
-                buf_reader
-                    .seek(SeekFrom::Start(
-                        (bmbt_rec_some.br_startblock + bmbt_rec_idx) * (self.block_size as u64),
-                    ))
-                    .unwrap();
-
-                buf_reader.seek(SeekFrom::Current(offset as i64)).unwrap();
-
-                while buf_reader.stream_position().unwrap()
-                    < ((bmbt_rec_some.br_startblock + bmbt_rec_idx + 1) * (self.block_size as u64))
-                {
-                    let freetag = buf_reader.read_u16::<BigEndian>().unwrap();
-                    buf_reader.seek(SeekFrom::Current(-2)).unwrap();
-
-                    if freetag == 0xffff {
-                        Dir2DataUnused::from(buf_reader.by_ref());
-                    } else if next {
-                        let entry = Dir2DataEntry::from(buf_reader.by_ref());
-
-                        let kind = get_file_type(FileKind::Type(entry.ftype))?;
-
-                        let name = entry.name;
+                let data = buf_reader.block(
+                    (bmbt_rec_some.br_startblock + bmbt_rec_idx) * (self.block_size as u64),
+                    self.block_size as usize,
+                );
+                let mut entries = Dir2DataEntryIter::new(&data, offset as usize);
+
+                if !next {
+                    // The cursor points at the entry returned last time;
+                    // skip it.
+                    entries.next();
+                    next = true;
+                }
 
-                        let tag = ((bmbt_rec_some.br_startoff + bmbt_rec_idx) << (64 - 48))
-                            | (entry.tag as u64);
+                if let Some(entry) = entries.next() {
+                    let kind = get_file_type(FileKind::Type(entry.ftype()))?;
 
-                        return Ok((entry.inumber, tag as i64, kind, name));
-                    } else {
-                        Dir2DataEntry::from(buf_reader.by_ref());
+                    let tag = ((bmbt_rec_some.br_startoff + bmbt_rec_idx) << (64 - 48))
+                        | (entry.tag() as u64);
 
-                        next = true;
-                    }
+                    return Ok((entry.inumber(), tag as i64, kind, entry.name()));
                 }
 
                 bmbt_rec_idx += 1;
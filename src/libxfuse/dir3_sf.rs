@@ -25,20 +25,21 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-use std::io::{BufRead, Seek};
-use std::time::{Duration, UNIX_EPOCH};
+use std::io::{BufRead, Read};
 
 use super::{
+    buf_cache::BlockReader,
+    da_btree::hashname,
     definitions::*,
     dinode::Dinode,
     dir3::Dir3,
     sb::Sb,
-    utils::{get_file_type, FileKind},
+    utils::{get_file_attrs, get_file_type, FileKind},
 };
 
 use byteorder::{BigEndian, ReadBytesExt};
 use fuser::{FileAttr, FileType};
-use libc::{c_int, ENOENT, S_IFMT};
+use libc::{c_int, ENOENT};
 
 // pub type XfsDir2SfOff = [u8; 2];
 
@@ -84,6 +85,13 @@ pub struct Dir2SfEntry {
 }
 
 impl Dir2SfEntry {
+    pub fn ino(&self) -> XfsIno {
+        match self.inumber {
+            XfsDir2Inou::XfsDir2Ino8(inumber) => inumber,
+            XfsDir2Inou::XfsDir2Ino4(inumber) => inumber as u64,
+        }
+    }
+
     pub fn from<T: BufRead>(buf_reader: &mut T, i8count: u8) -> Dir2SfEntry {
         let namelen = buf_reader.read_u8().unwrap();
 
@@ -116,6 +124,11 @@ impl Dir2SfEntry {
 pub struct Dir2Sf {
     pub hdr: Dir2SfHdr,
     pub list: Vec<Dir2SfEntry>,
+
+    // Entry indices sorted by name hash, built once at parse time so every
+    // lookup against this (cached) inode is a binary search instead of a
+    // decode-and-scan.
+    pub by_hash: Vec<(XfsDahash, u8)>,
 }
 
 impl Dir2Sf {
@@ -127,59 +140,46 @@ impl Dir2Sf {
             list.push(Dir2SfEntry::from(buf_reader.by_ref(), hdr.i8count))
         }
 
-        Dir2Sf { hdr, list }
+        let mut by_hash: Vec<(XfsDahash, u8)> = list
+            .iter()
+            .enumerate()
+            .map(|(i, entry)| (hashname(&entry.name), i as u8))
+            .collect();
+        by_hash.sort_unstable();
+
+        Dir2Sf { hdr, list, by_hash }
     }
 }
 
-impl<R: BufRead + Seek> Dir3<R> for Dir2Sf {
+impl Dir3 for Dir2Sf {
     fn lookup(
         &self,
-        buf_reader: &mut R,
+        buf_reader: &mut BlockReader<'_>,
         super_block: &Sb,
         name: &str,
     ) -> Result<(FileAttr, u64), c_int> {
+        // Binary search the hash index, then verify names across the run of
+        // equal hashes.
+        let hash = hashname(name);
         let mut inode: Option<XfsIno> = None;
 
-        for entry in self.list.iter() {
+        let start = self.by_hash.partition_point(|(h, _i)| *h < hash);
+        for (h, i) in &self.by_hash[start..] {
+            if *h != hash {
+                break;
+            }
+
+            let entry = &self.list[*i as usize];
             if entry.name == name {
-                inode = match entry.inumber {
-                    XfsDir2Inou::XfsDir2Ino8(inumber) => Some(inumber),
-                    XfsDir2Inou::XfsDir2Ino4(inumber) => Some(inumber as u64),
-                };
+                inode = Some(entry.ino());
+                break;
             }
         }
 
         if let Some(ino) = inode {
             let dinode = Dinode::from(buf_reader.by_ref(), super_block, ino);
 
-            let kind = get_file_type(FileKind::Mode(dinode.di_core.di_mode))?;
-
-            let attr = FileAttr {
-                ino,
-                size: dinode.di_core.di_size as u64,
-                blocks: dinode.di_core.di_nblocks,
-                atime: UNIX_EPOCH + Duration::new(
-                    dinode.di_core.di_atime.t_sec as u64,
-                    dinode.di_core.di_atime.t_nsec,
-                ),
-                mtime: UNIX_EPOCH + Duration::new(
-                    dinode.di_core.di_mtime.t_sec as u64,
-                    dinode.di_core.di_mtime.t_nsec,
-                ),
-                ctime: UNIX_EPOCH + Duration::new(
-                    dinode.di_core.di_ctime.t_sec as u64,
-                    dinode.di_core.di_ctime.t_nsec,
-                ),
-                crtime: UNIX_EPOCH,
-                kind,
-                perm: dinode.di_core.di_mode & (!(S_IFMT as u16)),
-                nlink: dinode.di_core.di_nlink,
-                uid: dinode.di_core.di_uid,
-                gid: dinode.di_core.di_gid,
-                rdev: 0,
-                blksize: 0,
-                flags: 0,
-            };
+            let attr = get_file_attrs(ino, &dinode.di_core)?;
 
             Ok((attr, dinode.di_core.di_gen.into()))
         } else {
@@ -188,26 +188,22 @@ impl<R: BufRead + Seek> Dir3<R> for Dir2Sf {
     }
 
     fn next(
-        &self,
-        _buf_reader: &mut R,
+        &mut self,
+        _buf_reader: &mut BlockReader<'_>,
         _super_block: &Sb,
         offset: i64,
     ) -> Result<(XfsIno, i64, FileType, String), c_int> {
-        for entry in self.list.iter() {
-            if i64::from(entry.offset) <= offset {
-                continue;
-            }
-
-            let ino = match entry.inumber {
-                XfsDir2Inou::XfsDir2Ino8(inumber) => inumber,
-                XfsDir2Inou::XfsDir2Ino4(inumber) => inumber as u64,
-            };
-
+        // Entries are decoded in offset order, so the first entry past the
+        // cursor is found by binary search.
+        let idx = self
+            .list
+            .partition_point(|entry| i64::from(entry.offset) <= offset);
+        if let Some(entry) = self.list.get(idx) {
             let kind = get_file_type(FileKind::Type(entry.ftype))?;
 
             let name = entry.name.to_owned();
 
-            return Ok((ino, entry.offset as i64, kind, name));
+            return Ok((entry.ino(), entry.offset as i64, kind, name));
         }
 
         Err(-1)
@@ -25,10 +25,27 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-use std::io::{BufRead, Seek};
-
+use super::buf_cache::BlockReader;
+use super::definitions::{XfsFileoff, XfsFsblock};
 use super::sb::Sb;
 
-pub trait File<R: BufRead + Seek> {
-    fn read(&mut self, buf_reader: &mut R, super_block: &Sb, offset: i64, size: u32) -> Vec<u8>;
+// Object safe (and Send) so the parsed file lives in the open-handle table
+// instead of being rebuilt on every read.
+pub trait File: std::fmt::Debug + Send {
+    fn read(
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
+        super_block: &Sb,
+        offset: i64,
+        size: u32,
+    ) -> Vec<u8>;
+
+    // Map a logical block to its filesystem block plus the number of
+    // contiguous blocks from there to the end of the extent.
+    fn map_run(
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
+        super_block: &Sb,
+        logical_block: XfsFileoff,
+    ) -> (XfsFsblock, u64);
 }
@@ -25,12 +25,17 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-use std::{
-    cmp::min,
-    io::{BufRead, Seek, SeekFrom},
-};
+use std::{cmp::min, io::Read};
 
-use super::{btree::Btree, definitions::XfsFsize, file::File, sb::Sb};
+use super::{
+    btree::Btree,
+    buf_cache::BlockReader,
+    buf_pool::pool,
+    definitions::{XfsFileoff, XfsFsblock, XfsFsize},
+    file::File,
+    io_backend::ReadRequest,
+    sb::Sb,
+};
 
 #[derive(Debug)]
 pub struct FileBtree {
@@ -39,39 +44,71 @@ pub struct FileBtree {
     pub block_size: u32,
 }
 
-impl<R: BufRead + Seek> File<R> for FileBtree {
-    fn read(&mut self, buf_reader: &mut R, super_block: &Sb, offset: i64, size: u32) -> Vec<u8> {
-        let mut data = Vec::<u8>::with_capacity(size as usize);
-
+impl File for FileBtree {
+    fn read(
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
+        super_block: &Sb,
+        offset: i64,
+        size: u32,
+    ) -> Vec<u8> {
         let mut remaining_size = min(size as i64, self.size - offset);
 
         if remaining_size < 0 {
             panic!("Offset is too large!");
         }
 
-        let mut logical_block = offset / i64::from(self.block_size);
-        let mut block_offset = offset % i64::from(self.block_size);
+        let block_size = i64::from(self.block_size);
+        let mut logical_block = offset / block_size;
+        let mut block_offset = offset % block_size;
+
+        // One descent per request; the iterator then streams records off
+        // the leaf level while every run covering the request is resolved
+        // up front.  The runs are then fetched concurrently and the reply
+        // assembled by offset, so a fragmented file costs the device's
+        // queue depth, not one latency per extent.
+        let mut extents =
+            self.btree
+                .extent_iter(buf_reader.by_ref(), super_block, logical_block as u64);
 
+        let mut requests = Vec::new();
+        let mut total = 0;
         while remaining_size > 0 {
-            let blk = self
-                .btree
-                .map_block(buf_reader.by_ref(), super_block, logical_block as u64);
-            buf_reader
-                .seek(SeekFrom::Start(blk * u64::from(self.block_size)))
-                .unwrap();
-            buf_reader.seek(SeekFrom::Current(block_offset)).unwrap();
+            let (blk, run_blocks) =
+                extents.map_run(buf_reader.by_ref(), super_block, logical_block as u64);
 
-            let size_to_read = min(remaining_size, (self.block_size as i64) - block_offset);
+            // One request covers the whole contiguous physical run, clamped
+            // at the extent boundary.
+            let size_to_read = min(
+                remaining_size,
+                ((run_blocks as i64) * block_size) - block_offset,
+            );
 
-            let mut buf = vec![0u8; size_to_read as usize];
-            buf_reader.read_exact(&mut buf).unwrap();
-            data.extend_from_slice(&buf);
+            requests.push(ReadRequest {
+                offset: ((blk as i64) * block_size + block_offset) as u64,
+                len: size_to_read as usize,
+                tag: total,
+            });
+            total += size_to_read as usize;
 
             remaining_size -= size_to_read;
-            logical_block += 1;
+            logical_block += (block_offset + size_to_read + block_size - 1) / block_size;
             block_offset = 0;
         }
 
+        let mut data = pool().take_zeroed(total);
+        buf_reader.read_scatter(requests, &mut data);
+
         data
     }
+
+    fn map_run(
+        &mut self,
+        buf_reader: &mut BlockReader<'_>,
+        super_block: &Sb,
+        logical_block: XfsFileoff,
+    ) -> (XfsFsblock, u64) {
+        self.btree
+            .map_run(buf_reader.by_ref(), super_block, logical_block)
+    }
 }
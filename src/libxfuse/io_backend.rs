@@ -0,0 +1,169 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+use std::fs::File;
+use std::io;
+use std::os::unix::fs::FileExt;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+use super::buf_pool::pool;
+
+// One read in a batch.  The tag ties a completion back to its request so
+// callers can place data even though completions arrive out of order.
+#[derive(Debug)]
+pub struct ReadRequest {
+    pub offset: u64,
+    pub len: usize,
+    pub tag: usize,
+}
+
+#[derive(Debug)]
+pub struct ReadCompletion {
+    pub tag: usize,
+    pub data: Vec<u8>,
+}
+
+// Backend that moves bytes off the device.  Batches are submitted whole and
+// completed in whatever order the device returns them, so independent
+// extents of one request can be in flight at once.  An io_uring or POSIX
+// AIO implementation slots in behind this same trait.
+pub trait IoBackend: std::fmt::Debug + Send + Sync {
+    fn submit(&self, requests: Vec<ReadRequest>) -> Vec<ReadCompletion>;
+}
+
+// Keep the queue depth bounded but the device busy: a batch is fanned out
+// over up to `depth` scoped threads issuing positioned reads on the shared
+// descriptor (pread carries no cursor, so no duplication is needed).
+#[derive(Debug)]
+pub struct PreadBackend {
+    device: File,
+    depth: usize,
+}
+
+impl PreadBackend {
+    pub fn new(device: File, depth: usize) -> PreadBackend {
+        PreadBackend {
+            device,
+            depth: std::cmp::max(depth, 1),
+        }
+    }
+
+    fn read_one(&self, request: &ReadRequest) -> ReadCompletion {
+        let mut data = pool().take_zeroed(request.len);
+
+        let mut filled = 0;
+        while filled < data.len() {
+            match self
+                .device
+                .read_at(&mut data[filled..], request.offset + (filled as u64))
+            {
+                Ok(0) => break,
+                Ok(n) => filled += n,
+                Err(ref err) if err.kind() == io::ErrorKind::Interrupted => continue,
+                Err(err) => panic!("Device read failed: {}", err),
+            }
+        }
+        data.truncate(filled);
+
+        ReadCompletion {
+            tag: request.tag,
+            data,
+        }
+    }
+}
+
+impl IoBackend for PreadBackend {
+    fn submit(&self, requests: Vec<ReadRequest>) -> Vec<ReadCompletion> {
+        if requests.len() <= 1 {
+            return requests.iter().map(|r| self.read_one(r)).collect();
+        }
+
+        let next = AtomicUsize::new(0);
+        let completions = Mutex::new(Vec::with_capacity(requests.len()));
+
+        let workers = std::cmp::min(self.depth, requests.len());
+        std::thread::scope(|scope| {
+            for _i in 0..workers {
+                scope.spawn(|| loop {
+                    let i = next.fetch_add(1, Ordering::Relaxed);
+                    if i >= requests.len() {
+                        break;
+                    }
+
+                    let completion = self.read_one(&requests[i]);
+                    completions.lock().unwrap().push(completion);
+                });
+            }
+        });
+
+        completions.into_inner().unwrap()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+
+    #[test]
+    fn batch_completions_cover_all_requests() {
+        let path = std::env::temp_dir().join(format!("xfuse-io-backend-{}", std::process::id()));
+        let mut file = std::fs::OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(true)
+            .open(&path)
+            .unwrap();
+        std::fs::remove_file(&path).unwrap();
+        let mut content = Vec::new();
+        for i in 0..65536u32 {
+            content.push((i % 251) as u8);
+        }
+        file.write_all(&content).unwrap();
+
+        let backend = PreadBackend::new(file, 4);
+
+        let requests = (0..16)
+            .map(|i| ReadRequest {
+                offset: (i as u64) * 4096,
+                len: 4096,
+                tag: i,
+            })
+            .collect();
+
+        let mut completions = backend.submit(requests);
+        completions.sort_by_key(|c| c.tag);
+
+        assert_eq!(completions.len(), 16);
+        for completion in completions {
+            let start = completion.tag * 4096;
+            assert_eq!(completion.data, &content[start..start + 4096]);
+        }
+    }
+}
@@ -0,0 +1,111 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+use std::fs::File;
+use std::os::unix::io::AsRawFd;
+use std::ptr;
+use std::slice;
+
+// A read-only mapping of the whole device image.  The filesystem never
+// writes, so the mapping is immutable and can be shared freely between the
+// worker threads; the kernel page cache becomes the only copy of the data.
+#[derive(Debug)]
+pub struct Mmap {
+    ptr: *mut libc::c_void,
+    len: usize,
+}
+
+unsafe impl Send for Mmap {}
+unsafe impl Sync for Mmap {}
+
+impl Mmap {
+    // Map the device; returns None if it cannot be mapped (e.g. a character
+    // device), in which case the caller falls back to plain reads.
+    pub fn new(device: &File) -> Option<Mmap> {
+        let len = device.metadata().unwrap().len() as usize;
+        if len == 0 {
+            return None;
+        }
+
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_SHARED,
+                device.as_raw_fd(),
+                0,
+            )
+        };
+
+        if ptr == libc::MAP_FAILED {
+            None
+        } else {
+            Some(Mmap { ptr, len })
+        }
+    }
+
+    pub fn as_slice(&self) -> &[u8] {
+        unsafe { slice::from_raw_parts(self.ptr as *const u8, self.len) }
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    // Ask the kernel to start paging in the given range of the mapping.
+    pub fn advise_willneed(&self, offset: u64, len: usize) {
+        // madvise wants a page-aligned address; widen the range to cover it.
+        let page = 4096;
+        let aligned = (offset as usize) & !(page - 1);
+        if aligned >= self.len {
+            return;
+        }
+        let len = std::cmp::min(len + ((offset as usize) - aligned), self.len - aligned);
+        let offset = aligned;
+
+        unsafe {
+            libc::madvise(
+                (self.ptr as *mut u8).add(offset) as *mut libc::c_void,
+                len,
+                libc::MADV_WILLNEED,
+            );
+        }
+    }
+}
+
+impl Drop for Mmap {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.ptr, self.len);
+        }
+    }
+}
@@ -33,6 +33,10 @@ pub mod attr_node;
 pub mod attr_shortform;
 pub mod bmbt_rec;
 pub mod btree;
+pub mod buf_cache;
+pub mod buf_pool;
+pub mod cache;
+pub mod checksum;
 pub mod da_btree;
 pub mod definitions;
 pub mod dinode;
@@ -46,7 +50,13 @@ pub mod dir3_sf;
 pub mod file;
 pub mod file_btree;
 pub mod file_extent_list;
+pub mod io_backend;
+pub mod mmap;
 pub mod sb;
+pub mod slab;
+pub mod stats;
 pub mod symlink_extent;
+pub mod threadpool;
 pub mod utils;
+pub mod view;
 pub mod volume;
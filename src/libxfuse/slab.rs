@@ -0,0 +1,106 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// A slab with a free list: O(1) insert and remove, and keys stay stable for
+// the lifetime of their entry.  Used for the open file handle table, where
+// the key is handed to the kernel as the file handle.
+#[derive(Debug)]
+pub struct Slab<T> {
+    entries: Vec<Option<T>>,
+    free: Vec<usize>,
+    capacity: usize,
+}
+
+impl<T> Slab<T> {
+    pub fn new(capacity: usize) -> Slab<T> {
+        Slab {
+            entries: Vec::new(),
+            free: Vec::new(),
+            capacity,
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len() - self.free.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    // Insert a value, reusing a freed slot when one exists.  Returns None
+    // when the table is at capacity.
+    pub fn insert(&mut self, value: T) -> Option<usize> {
+        if let Some(key) = self.free.pop() {
+            self.entries[key] = Some(value);
+            return Some(key);
+        }
+
+        if self.entries.len() >= self.capacity {
+            return None;
+        }
+
+        self.entries.push(Some(value));
+        Some(self.entries.len() - 1)
+    }
+
+    pub fn get(&self, key: usize) -> Option<&T> {
+        self.entries.get(key).and_then(|slot| slot.as_ref())
+    }
+
+    pub fn remove(&mut self, key: usize) -> Option<T> {
+        let value = self.entries.get_mut(key).and_then(|slot| slot.take());
+        if value.is_some() {
+            self.free.push(key);
+        }
+
+        value
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn slab_reuses_slots_and_keeps_keys_stable() {
+        let mut slab = Slab::new(2);
+
+        let a = slab.insert("a").unwrap();
+        let b = slab.insert("b").unwrap();
+        assert_eq!(slab.insert("c"), None);
+
+        assert_eq!(slab.remove(a), Some("a"));
+        assert_eq!(slab.get(b), Some(&"b"));
+
+        let c = slab.insert("c").unwrap();
+        assert_eq!(c, a);
+        assert_eq!(slab.get(c), Some(&"c"));
+        assert_eq!(slab.len(), 2);
+    }
+}
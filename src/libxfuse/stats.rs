@@ -0,0 +1,196 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::OnceLock;
+use std::time::Duration;
+
+// Per-operation trace logging, compiled out unless the `trace` feature is
+// enabled so the hot path carries no formatting or stdout writes.
+#[macro_export]
+macro_rules! trace {
+    ($($arg:tt)*) => {
+        #[cfg(feature = "trace")]
+        println!($($arg)*);
+    };
+}
+
+// Histogram buckets are powers of two nanoseconds; bucket i counts
+// latencies in [2^i, 2^(i+1)).  2^39 ns is about nine minutes, enough
+// headroom for anything worth graphing.
+const LATENCY_BUCKETS: usize = 40;
+
+// Count and latency histogram for one operation type.  Recording is two
+// relaxed atomic increments, so contended callbacks never serialize on it.
+#[derive(Debug)]
+pub struct OpStats {
+    count: AtomicU64,
+    buckets: [AtomicU64; LATENCY_BUCKETS],
+}
+
+impl Default for OpStats {
+    fn default() -> OpStats {
+        OpStats {
+            count: AtomicU64::new(0),
+            buckets: std::array::from_fn(|_i| AtomicU64::new(0)),
+        }
+    }
+}
+
+impl OpStats {
+    pub fn record(&self, elapsed: Duration) {
+        self.count.fetch_add(1, Ordering::Relaxed);
+
+        let nanos = std::cmp::max(elapsed.as_nanos() as u64, 1);
+        let bucket = std::cmp::min((63 - nanos.leading_zeros()) as usize, LATENCY_BUCKETS - 1);
+        self.buckets[bucket].fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub fn count(&self) -> u64 {
+        self.count.load(Ordering::Relaxed)
+    }
+
+    // Upper bound of the bucket holding the given quantile, in nanoseconds.
+    fn quantile(&self, q: f64) -> u64 {
+        let total = self.count();
+        if total == 0 {
+            return 0;
+        }
+
+        let target = ((total as f64) * q).ceil() as u64;
+        let mut seen = 0;
+        for (i, bucket) in self.buckets.iter().enumerate() {
+            seen += bucket.load(Ordering::Relaxed);
+            if seen >= target {
+                return 1u64 << (i + 1);
+            }
+        }
+
+        1u64 << LATENCY_BUCKETS
+    }
+}
+
+// Hits and misses of one cache.
+#[derive(Debug, Default)]
+pub struct CacheStats {
+    hits: AtomicU64,
+    misses: AtomicU64,
+}
+
+impl CacheStats {
+    pub fn hit(&self) {
+        self.hits.fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub fn miss(&self) {
+        self.misses.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+// All counters for the process.  There is one volume per process, so like
+// the hashname memo this lives in a process-wide static; the buffer cache
+// and the volume both feed it without threading a handle through every
+// parser signature.
+#[derive(Debug, Default)]
+pub struct Stats {
+    pub lookup: OpStats,
+    pub getattr: OpStats,
+    pub read: OpStats,
+    pub readdir: OpStats,
+    pub inode_cache: CacheStats,
+    pub dentry_cache: CacheStats,
+    pub block_cache: CacheStats,
+    pub xattr_cache: CacheStats,
+}
+
+impl Stats {
+    // Render every counter as one "name value" line per datum, the format
+    // exported through the virtual stats xattr for scraping.
+    pub fn report(&self) -> String {
+        let mut out = String::new();
+
+        for (name, op) in [
+            ("lookup", &self.lookup),
+            ("getattr", &self.getattr),
+            ("read", &self.read),
+            ("readdir", &self.readdir),
+        ] {
+            out.push_str(&format!("{}_count {}\n", name, op.count()));
+            out.push_str(&format!("{}_p50_ns {}\n", name, op.quantile(0.50)));
+            out.push_str(&format!("{}_p99_ns {}\n", name, op.quantile(0.99)));
+        }
+
+        for (name, cache) in [
+            ("inode_cache", &self.inode_cache),
+            ("dentry_cache", &self.dentry_cache),
+            ("block_cache", &self.block_cache),
+            ("xattr_cache", &self.xattr_cache),
+        ] {
+            out.push_str(&format!(
+                "{}_hits {}\n",
+                name,
+                cache.hits.load(Ordering::Relaxed)
+            ));
+            out.push_str(&format!(
+                "{}_misses {}\n",
+                name,
+                cache.misses.load(Ordering::Relaxed)
+            ));
+        }
+
+        out
+    }
+}
+
+pub fn stats() -> &'static Stats {
+    static STATS: OnceLock<Stats> = OnceLock::new();
+    STATS.get_or_init(Stats::default)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn histogram_quantiles_track_recorded_latencies() {
+        let op = OpStats::default();
+
+        for _i in 0..99 {
+            op.record(Duration::from_micros(10));
+        }
+        op.record(Duration::from_millis(50));
+
+        assert_eq!(op.count(), 100);
+        // 10us falls in the [2^13, 2^14) bucket.
+        assert_eq!(op.quantile(0.50), 1 << 14);
+        // The one 50ms outlier only surfaces at the very top.
+        assert!(op.quantile(1.0) > 1 << 25);
+
+        let empty = OpStats::default();
+        assert_eq!(empty.quantile(0.99), 0);
+    }
+}
@@ -25,8 +25,12 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-use fuser::FileType;
+use std::time::{Duration, UNIX_EPOCH};
 
+use fuser::{FileAttr, FileType};
+
+use super::definitions::XfsIno;
+use super::dinode_core::DinodeCore;
 use super::dir3::{XFS_DIR3_FT_DIR, XFS_DIR3_FT_REG_FILE, XFS_DIR3_FT_SYMLINK};
 
 use libc::{c_int, mode_t, ENOENT, S_IFDIR, S_IFLNK, S_IFMT, S_IFREG};
@@ -58,3 +62,27 @@ pub fn get_file_type(kind: FileKind) -> Result<FileType, c_int> {
         },
     }
 }
+
+// Build the FileAttr for an inode from its parsed core.  All the lookup and
+// attribute paths return the same shape, so they share this.
+pub fn get_file_attrs(ino: XfsIno, core: &DinodeCore) -> Result<FileAttr, c_int> {
+    let kind = get_file_type(FileKind::Mode(core.di_mode))?;
+
+    Ok(FileAttr {
+        ino,
+        size: core.di_size as u64,
+        blocks: core.di_nblocks,
+        atime: UNIX_EPOCH + Duration::new(core.di_atime.t_sec as u64, core.di_atime.t_nsec),
+        mtime: UNIX_EPOCH + Duration::new(core.di_mtime.t_sec as u64, core.di_mtime.t_nsec),
+        ctime: UNIX_EPOCH + Duration::new(core.di_ctime.t_sec as u64, core.di_ctime.t_nsec),
+        crtime: UNIX_EPOCH,
+        kind,
+        perm: core.di_mode & (!(S_IFMT as u16)),
+        nlink: core.di_nlink,
+        uid: core.di_uid,
+        gid: core.di_gid,
+        rdev: 0,
+        blksize: 16384,
+        flags: 0,
+    })
+}
@@ -0,0 +1,320 @@
+/**
+ * BSD 2-Clause License
+ *
+ * Copyright (c) 2021, Khaled Emara
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+use std::convert::TryInto;
+
+use super::definitions::{XfsDahash, XfsIno};
+use super::dir3::XfsDir2DataOff;
+
+// Zero-copy views over on-disk structures.  Each view borrows a block-sized
+// slice obtained from the buffer cache and decodes big-endian fields on
+// demand, so walking a block is pointer arithmetic instead of per-field
+// reader calls and per-entry allocations.
+
+fn be_u16(data: &[u8], offset: usize) -> u16 {
+    u16::from_be_bytes(data[offset..offset + 2].try_into().unwrap())
+}
+
+fn be_u32(data: &[u8], offset: usize) -> u32 {
+    u32::from_be_bytes(data[offset..offset + 4].try_into().unwrap())
+}
+
+fn be_u64(data: &[u8], offset: usize) -> u64 {
+    u64::from_be_bytes(data[offset..offset + 8].try_into().unwrap())
+}
+
+// Tag value marking a directory data region as unused.
+pub const XFS_DIR2_DATA_FREE_TAG: u16 = 0xffff;
+
+#[derive(Debug)]
+pub struct Dir3DataHdrView<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> Dir3DataHdrView<'a> {
+    // Dir3BlkHdr (48 bytes) + 3 best_free entries + pad.
+    pub const SIZE: usize = 64;
+
+    pub fn new(data: &'a [u8]) -> Dir3DataHdrView<'a> {
+        Dir3DataHdrView { data }
+    }
+
+    pub fn magic(&self) -> u32 {
+        be_u32(self.data, 0)
+    }
+}
+
+// A directory data entry at a byte offset within its block.  The freetag
+// check belongs to the caller; construct this only over a live entry.
+#[derive(Debug)]
+pub struct Dir2DataEntryView<'a> {
+    data: &'a [u8],
+    offset: usize,
+}
+
+impl<'a> Dir2DataEntryView<'a> {
+    pub fn new(data: &'a [u8], offset: usize) -> Dir2DataEntryView<'a> {
+        Dir2DataEntryView { data, offset }
+    }
+
+    pub fn inumber(&self) -> XfsIno {
+        be_u64(self.data, self.offset)
+    }
+
+    pub fn namelen(&self) -> u8 {
+        self.data[self.offset + 8]
+    }
+
+    pub fn name_bytes(&self) -> &'a [u8] {
+        &self.data[self.offset + 9..self.offset + 9 + (self.namelen() as usize)]
+    }
+
+    pub fn name(&self) -> String {
+        self.name_bytes().iter().map(|b| *b as char).collect()
+    }
+
+    pub fn ftype(&self) -> u8 {
+        self.data[self.offset + 9 + (self.namelen() as usize)]
+    }
+
+    // Entry length: inumber + namelen + name + ftype + tag, padded to an
+    // 8 byte boundary.
+    pub fn length(&self) -> usize {
+        ((12 + (self.namelen() as usize)) + 7) & !7
+    }
+
+    pub fn tag(&self) -> XfsDir2DataOff {
+        be_u16(self.data, self.offset + self.length() - 2)
+    }
+}
+
+#[derive(Debug)]
+pub struct Dir2DataUnusedView<'a> {
+    data: &'a [u8],
+    offset: usize,
+}
+
+impl<'a> Dir2DataUnusedView<'a> {
+    pub fn new(data: &'a [u8], offset: usize) -> Dir2DataUnusedView<'a> {
+        Dir2DataUnusedView { data, offset }
+    }
+
+    pub fn freetag(&self) -> u16 {
+        be_u16(self.data, self.offset)
+    }
+
+    pub fn length(&self) -> usize {
+        be_u16(self.data, self.offset + 2) as usize
+    }
+}
+
+// Iterate the live entries of a directory data region, skipping unused
+// space, from a starting byte offset up to the end of the slice.
+#[derive(Debug)]
+pub struct Dir2DataEntryIter<'a> {
+    data: &'a [u8],
+    offset: usize,
+}
+
+impl<'a> Dir2DataEntryIter<'a> {
+    pub fn new(data: &'a [u8], offset: usize) -> Dir2DataEntryIter<'a> {
+        Dir2DataEntryIter { data, offset }
+    }
+}
+
+impl<'a> Iterator for Dir2DataEntryIter<'a> {
+    type Item = Dir2DataEntryView<'a>;
+
+    fn next(&mut self) -> Option<Dir2DataEntryView<'a>> {
+        while self.offset + 2 <= self.data.len() {
+            if be_u16(self.data, self.offset) == XFS_DIR2_DATA_FREE_TAG {
+                let unused = Dir2DataUnusedView::new(self.data, self.offset);
+                self.offset += unused.length();
+                continue;
+            }
+
+            let entry = Dir2DataEntryView::new(self.data, self.offset);
+            if self.offset + entry.length() > self.data.len() {
+                return None;
+            }
+            self.offset += entry.length();
+
+            return Some(entry);
+        }
+
+        None
+    }
+}
+
+#[derive(Debug)]
+pub struct Dir2LeafEntryView<'a> {
+    data: &'a [u8],
+    offset: usize,
+}
+
+impl<'a> Dir2LeafEntryView<'a> {
+    pub const SIZE: usize = 8;
+
+    pub fn new(data: &'a [u8], offset: usize) -> Dir2LeafEntryView<'a> {
+        Dir2LeafEntryView { data, offset }
+    }
+
+    pub fn hashval(&self) -> XfsDahash {
+        be_u32(self.data, self.offset)
+    }
+
+    pub fn address(&self) -> u32 {
+        be_u32(self.data, self.offset + 4)
+    }
+}
+
+#[derive(Debug)]
+pub struct AttrLeafEntryView<'a> {
+    data: &'a [u8],
+    offset: usize,
+}
+
+impl<'a> AttrLeafEntryView<'a> {
+    pub const SIZE: usize = 8;
+
+    pub fn new(data: &'a [u8], offset: usize) -> AttrLeafEntryView<'a> {
+        AttrLeafEntryView { data, offset }
+    }
+
+    pub fn hashval(&self) -> XfsDahash {
+        be_u32(self.data, self.offset)
+    }
+
+    pub fn nameidx(&self) -> u16 {
+        be_u16(self.data, self.offset + 4)
+    }
+
+    pub fn flags(&self) -> u8 {
+        self.data[self.offset + 6]
+    }
+}
+
+#[derive(Debug)]
+pub struct AttrLeafNameLocalView<'a> {
+    data: &'a [u8],
+    offset: usize,
+}
+
+impl<'a> AttrLeafNameLocalView<'a> {
+    pub fn new(data: &'a [u8], offset: usize) -> AttrLeafNameLocalView<'a> {
+        AttrLeafNameLocalView { data, offset }
+    }
+
+    pub fn valuelen(&self) -> u16 {
+        be_u16(self.data, self.offset)
+    }
+
+    pub fn namelen(&self) -> u8 {
+        self.data[self.offset + 2]
+    }
+
+    pub fn name_bytes(&self) -> &'a [u8] {
+        &self.data[self.offset + 3..self.offset + 3 + (self.namelen() as usize)]
+    }
+
+    pub fn value_bytes(&self) -> &'a [u8] {
+        let start = self.offset + 3 + (self.namelen() as usize);
+        &self.data[start..start + (self.valuelen() as usize)]
+    }
+}
+
+#[derive(Debug)]
+pub struct AttrLeafNameRemoteView<'a> {
+    data: &'a [u8],
+    offset: usize,
+}
+
+impl<'a> AttrLeafNameRemoteView<'a> {
+    pub fn new(data: &'a [u8], offset: usize) -> AttrLeafNameRemoteView<'a> {
+        AttrLeafNameRemoteView { data, offset }
+    }
+
+    pub fn valueblk(&self) -> u32 {
+        be_u32(self.data, self.offset)
+    }
+
+    pub fn valuelen(&self) -> u32 {
+        be_u32(self.data, self.offset + 4)
+    }
+
+    pub fn namelen(&self) -> u8 {
+        self.data[self.offset + 8]
+    }
+
+    pub fn name_bytes(&self) -> &'a [u8] {
+        &self.data[self.offset + 9..self.offset + 9 + (self.namelen() as usize)]
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn data_entry_iteration_skips_unused_space() {
+        // One 16 byte entry ("file", inumber 42, ftype 1), a 16 byte unused
+        // region, then another entry ("a", inumber 7, ftype 2).
+        let mut block = Vec::new();
+
+        block.extend_from_slice(&42u64.to_be_bytes());
+        block.push(4);
+        block.extend_from_slice(b"file");
+        block.push(1);
+        block.extend_from_slice(&0u16.to_be_bytes()); // tag
+
+        block.extend_from_slice(&XFS_DIR2_DATA_FREE_TAG.to_be_bytes());
+        block.extend_from_slice(&16u16.to_be_bytes());
+        block.extend_from_slice(&[0u8; 12]);
+
+        block.extend_from_slice(&7u64.to_be_bytes());
+        block.push(1);
+        block.extend_from_slice(b"a");
+        block.push(2);
+        block.extend_from_slice(&[0u8; 3]); // pad
+        block.extend_from_slice(&32u16.to_be_bytes()); // tag
+
+        let mut iter = Dir2DataEntryIter::new(&block, 0);
+
+        let entry = iter.next().unwrap();
+        assert_eq!(entry.inumber(), 42);
+        assert_eq!(entry.name(), "file");
+        assert_eq!(entry.ftype(), 1);
+        assert_eq!(entry.length(), 16);
+
+        let entry = iter.next().unwrap();
+        assert_eq!(entry.inumber(), 7);
+        assert_eq!(entry.name(), "a");
+        assert_eq!(entry.tag(), 32);
+
+        assert!(iter.next().is_none());
+    }
+}
@@ -26,9 +26,8 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
-mod libxfuse;
-
-use libxfuse::volume::Volume;
+use xfs_fuse::libxfuse::checksum::CrcCheckMode;
+use xfs_fuse::libxfuse::volume::{Config, Volume};
 
 use clap::crate_version;
 use fuser::{mount2, MountOption};
@@ -52,8 +51,55 @@ fn main() {
         MountOption::FSName("fusefs".to_string()),
         MountOption::Subtype("xfs".to_string())
     ];
+    let mut config = Config::default();
     if let Some(it) = matches.values_of("option") {
         for o in it {
+            // Options consumed by xfs-fuse itself are not forwarded to the
+            // kernel.
+            if let Some(value) = o.strip_prefix("icachesize=") {
+                config.inode_cache_size = value.parse().unwrap();
+                continue;
+            }
+            if let Some(value) = o.strip_prefix("bcachesize=") {
+                config.block_cache_bytes = value.parse::<usize>().unwrap() * 1024 * 1024;
+                continue;
+            }
+            if let Some(value) = o.strip_prefix("workers=") {
+                config.workers = value.parse().unwrap();
+                continue;
+            }
+            if o == "mmap" {
+                config.mmap = true;
+                continue;
+            }
+            if let Some(value) = o.strip_prefix("readahead=") {
+                config.readahead_bytes = value.parse::<usize>().unwrap() * 1024;
+                continue;
+            }
+            if let Some(value) = o.strip_prefix("dcachesize=") {
+                config.dentry_cache_size = value.parse().unwrap();
+                continue;
+            }
+            if let Some(value) = o.strip_prefix("maxfiles=") {
+                config.open_files_capacity = value.parse().unwrap();
+                continue;
+            }
+            if let Some(value) = o.strip_prefix("crccheck=") {
+                config.crc_check = CrcCheckMode::parse(value);
+                continue;
+            }
+            if let Some(value) = o.strip_prefix("iodepth=") {
+                config.io_depth = value.parse().unwrap();
+                continue;
+            }
+            if o == "prewarm" {
+                config.prewarm = true;
+                continue;
+            }
+            if o == "preload-metadata" {
+                config.preload_metadata = true;
+                continue;
+            }
             opts.push(match o {
                 "auto_unmount" => MountOption::AutoUnmount,
                 "allow_other" => MountOption::AllowOther,
@@ -80,7 +126,7 @@ fn main() {
     let device = matches.value_of("device").unwrap().to_string();
     let mountpoint = matches.value_of("mountpoint").unwrap().to_string();
 
-    let vol = Volume::from(&device);
+    let vol = Volume::from(&device, &config);
 
     mount2(vol, &mountpoint, &opts[..]).unwrap();
 }